@@ -42,6 +42,11 @@ local BUILD_OPTS = {
 	"-Wshorten-64-to-32"
 }
 
+-- Project-wide linker flags for all builds:
+local LINK_OPTS = {
+	"-pthread" -- std::thread used by the parallel extraction.
+}
+
 -- Project-wide Debug build switches:
 local DEBUG_DEFS = {
 	"DEBUG", "_DEBUG",  -- Enables assert()
@@ -67,6 +72,7 @@ local LIB_OL_NAME = "OL"
 workspace "Outlaws"
 	configurations { "Debug", "Release" }
 	buildoptions   { BUILD_OPTS  }
+	linkoptions    { LINK_OPTS   }
 	defines        { COMMON_DEFS }
 	language       "C++"
 	location       "build"
@@ -111,6 +117,46 @@ project "lab_pack"
 	files       { "source/lab_pack.cpp" }
 	links       { LIB_OL_NAME }
 
+------------------------------------------------------
+-- lab_verify command line tool:
+------------------------------------------------------
+
+project "lab_verify"
+	kind        "ConsoleApp"
+	includedirs { "source/" }
+	files       { "source/lab_verify.cpp" }
+	links       { LIB_OL_NAME }
+
+------------------------------------------------------
+-- lab_edit command line tool:
+------------------------------------------------------
+
+project "lab_edit"
+	kind        "ConsoleApp"
+	includedirs { "source/" }
+	files       { "source/lab_edit.cpp" }
+	links       { LIB_OL_NAME }
+
+------------------------------------------------------
+-- lab_bench benchmark suite:
+------------------------------------------------------
+
+project "lab_bench"
+	kind        "ConsoleApp"
+	includedirs { "source/" }
+	files       { "source/lab_bench.cpp" }
+	links       { LIB_OL_NAME }
+
+------------------------------------------------------
+-- lab_gen scale-test archive generator:
+------------------------------------------------------
+
+project "lab_gen"
+	kind        "ConsoleApp"
+	includedirs { "source/" }
+	files       { "source/lab_gen.cpp" }
+	links       { LIB_OL_NAME }
+
 ------------------------------------------------------
 -- A temporary driver program:
 ------------------------------------------------------
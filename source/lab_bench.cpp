@@ -0,0 +1,727 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_bench.cpp
+// Created on: 16/10/26
+// Brief: Benchmarks for reading and writing LAB archives, run over a synthetic corpus.
+// ================================================================================================
+
+#include "ol/filesys_utils.hpp"
+#include "ol/lab_archive_reader.hpp"
+#include "ol/lab_archive_writer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchConfig
+{
+	std::size_t   entryCount = 2000;
+	std::size_t   minSize    = 64;
+	std::size_t   maxSize    = 256 * 1024;
+	bool          logSizes   = true;  // Log-uniform sizes: many small entries, few big ones, like game assets.
+	int           iterations = 5;
+	std::size_t   lookups    = 100000;
+	int           numThreads = 1;
+	unsigned      seed       = 1234;
+	std::string   workDir    = "lab_bench_tmp/";
+	bool          keepFiles  = false; // Set by --dir, otherwise the files are removed at the end.
+	std::string   jsonFile;           // Empty for none, "-" for STDOUT.
+};
+
+// Timings of one benchmark. Each sample is the time of one operation; operations too
+// fast for the clock are timed in batches of opsPerSample and averaged over the batch.
+struct BenchResult
+{
+	std::string         name;
+	std::vector<double> seconds;
+	std::uint64_t       bytesPerOp   = 0; // For throughput, zero if it doesn't apply.
+	std::size_t         opsPerSample = 1;
+
+	double total() const
+	{
+		double sum = 0.0;
+		for (const double s : seconds) { sum += s; }
+		return sum * opsPerSample;
+	}
+
+	std::size_t opCount() const
+	{
+		return seconds.size() * opsPerSample;
+	}
+
+	// Nearest-rank percentile, p in [0,1].
+	double percentile(const double p) const
+	{
+		if (seconds.empty()) { return 0.0; }
+		std::vector<double> sorted = seconds;
+		std::sort(std::begin(sorted), std::end(sorted));
+		const auto rank = static_cast<std::size_t>(std::ceil(p * sorted.size()));
+		return sorted[(rank > 0 ? rank : 1) - 1];
+	}
+
+	double opsPerSecond() const
+	{
+		const double t = total();
+		return (t > 0.0) ? (opCount() / t) : 0.0;
+	}
+
+	double megabytesPerSecond() const
+	{
+		const double t = total();
+		return (t > 0.0 && bytesPerOp != 0) ? (double(bytesPerOp) * opCount() / (1024.0 * 1024.0) / t) : 0.0;
+	}
+};
+
+static void printHelpText(const char * progName)
+{
+	std::cout
+		<< "\n"
+		<< "Usage:\n"
+		<< "$ " << progName << " [--entries | -n <N>] [--sizes <min>:<max>] [--dist log | uniform]\n"
+		<< "  [--iterations | -i <N>] [--lookups <N>] [--jobs | -j <N>] [--seed <N>]\n"
+		<< "  [--dir | -d <work_dir>] [--json <file>]\n"
+		<< "  Generates a synthetic LAB corpus of N entries (default 2000) with sizes between min and max\n"
+		<< "  bytes (default 64:262144), log-uniformly distributed by default, then benchmarks\n"
+		<< "  LabArchiveWriter::write, LabArchiveReader::open in each mode, name lookups, single entry\n"
+		<< "  reads and extractWholeArchive. Each timed operation is a sample, except name lookups, which\n"
+		<< "  are timed in batches of 256 and averaged; p50/p99 latencies and throughput are printed to\n"
+		<< "  STDOUT, and written as JSON to the --json file (\"-\" for STDOUT).\n"
+		<< "  --iterations|-i sets the samples for whole-archive operations (default 5).\n"
+		<< "  --lookups sets the number of name lookups and entry reads (default 100000).\n"
+		<< "  --jobs|-j sets the threads used by write and extract (default 1, 0 = one per CPU core).\n"
+		<< "  Files are created in the work directory, \"lab_bench_tmp/\" by default, and removed at\n"
+		<< "  the end of the run. Files written to a directory given with --dir|-d are left there.\n"
+		<< "\n"
+		<< "Usage:\n"
+		<< "$ " << progName << " --help | -h\n"
+		<< "  Prints this help text.\n"
+		<< "\n";
+}
+
+// Value following the flag at argv[i], advancing i. Null if missing.
+static const char * getFlagValue(const int argc, const char * argv[], int & i)
+{
+	if (i + 1 >= argc)
+	{
+		std::cerr << "Missing value after " << argv[i] << "!\n";
+		return nullptr;
+	}
+	return argv[++i];
+}
+
+// Decimal number no greater than maxValue. strtoull() would quietly negate a
+// leading minus sign, so only digits are accepted. If valueEnd is null there
+// must be nothing after the number, otherwise it gets the first char past it.
+static bool parseNumber(const char * value, const std::uint64_t maxValue, std::uint64_t & number,
+                        const char ** valueEnd = nullptr)
+{
+	if (*value < '0' || *value > '9')
+	{
+		return false;
+	}
+
+	char * end = nullptr;
+	number = std::strtoull(value, &end, 10);
+	if (number > maxValue)
+	{
+		return false;
+	}
+
+	if (valueEnd != nullptr)
+	{
+		*valueEnd = end;
+		return true;
+	}
+	return *end == '\0';
+}
+
+template<class Func>
+static double timeIt(Func && func)
+{
+	const auto start = Clock::now();
+	func();
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// ========================================================
+// Synthetic corpus:
+// ========================================================
+
+struct CorpusEntry
+{
+	std::string               name;
+	std::vector<std::uint8_t> data;
+};
+
+static std::vector<CorpusEntry> generateCorpus(const BenchConfig & config, std::uint64_t & totalBytes)
+{
+	static const char * const extensions[] = { ".pcx", ".wav", ".nwx", ".itm", ".atx", ".lvt", ".msg", ".txt" };
+	const std::size_t extCount = sizeof(extensions) / sizeof(extensions[0]);
+
+	std::mt19937 rng{ config.seed };
+	std::uniform_real_distribution<double> unit{ 0.0, 1.0 };
+
+	std::vector<CorpusEntry> corpus(config.entryCount);
+	totalBytes = 0;
+
+	for (std::size_t i = 0; i < corpus.size(); ++i)
+	{
+		const double t = unit(rng);
+		const double minSize = double(config.minSize);
+		const double maxSize = double(config.maxSize);
+		const double size = config.logSizes ?
+			std::exp(std::log(minSize) + t * (std::log(maxSize) - std::log(minSize))) :
+			(minSize + t * (maxSize - minSize));
+
+		// A few directories, like the game data.
+		std::ostringstream name;
+		name << "dir" << (i % 16) << "\\entry" << std::setw(6) << std::setfill('0') << i << extensions[i % extCount];
+
+		auto & entry = corpus[i];
+		entry.name = name.str();
+		entry.data.resize(static_cast<std::size_t>(size));
+
+		// Cheap pseudo-random fill; contents don't matter, but shouldn't be all zeros.
+		std::uint32_t x = static_cast<std::uint32_t>(rng()) | 1;
+		for (auto & byte : entry.data)
+		{
+			x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+			byte = static_cast<std::uint8_t>(x);
+		}
+		totalBytes += entry.data.size();
+	}
+	return corpus;
+}
+
+// Deletes the archive and the extracted corpus, then the directories
+// they were in if that left them empty. Missing files are skipped.
+static void removeBenchFiles(const std::string & workDir, const std::vector<CorpusEntry> & corpus)
+{
+	const std::string extractDir = workDir + "extracted/";
+	std::vector<std::string> subDirs;
+
+	for (const auto & entry : corpus)
+	{
+		std::string path = entry.name;
+		std::replace(std::begin(path), std::end(path), '\\', '/');
+		std::remove((extractDir + path).c_str());
+
+		for (auto sep = path.rfind('/'); sep != std::string::npos && sep != 0; sep = path.rfind('/', sep - 1))
+		{
+			subDirs.push_back(path.substr(0, sep));
+		}
+	}
+
+	// Deepest first, so each directory is empty by the time it's removed.
+	std::sort(std::begin(subDirs), std::end(subDirs));
+	subDirs.erase(std::unique(std::begin(subDirs), std::end(subDirs)), std::end(subDirs));
+	std::sort(std::begin(subDirs), std::end(subDirs),
+		[](const std::string & a, const std::string & b) { return a.length() > b.length(); });
+
+	for (const auto & dir : subDirs)
+	{
+		ol::filesys::removeDirectory(extractDir + dir);
+	}
+	ol::filesys::removeDirectory(extractDir);
+
+	std::remove((workDir + "bench.lab").c_str());
+	ol::filesys::removeDirectory(workDir);
+}
+
+// ========================================================
+// Benchmarks:
+// ========================================================
+
+static bool benchWrite(const BenchConfig & config, const std::vector<CorpusEntry> & corpus, const std::string & labFile,
+                       std::uint64_t & archiveBytes, std::vector<BenchResult> & results)
+{
+	BenchResult toFile;
+	toFile.name = "write_file";
+
+	BenchResult toMemory;
+	toMemory.name = "write_memory";
+
+	for (int i = 0; i < config.iterations; ++i)
+	{
+		// Adding copies the entries, which is not what is being measured.
+		ol::LabArchiveWriter fileWriter;
+		ol::LabArchiveWriter memoryWriter;
+		for (const auto & entry : corpus)
+		{
+			fileWriter.addEntry(entry.name, entry.data.data(), entry.data.size());
+			memoryWriter.addEntry(entry.name, entry.data.data(), entry.data.size());
+		}
+
+		bool ok = true;
+		toFile.seconds.push_back(timeIt([&]()
+		{
+			ol::LabFileSink sink{ labFile };
+			ok = sink.open() && fileWriter.write(sink, ol::LabArchiveWriter::WriteMode::InMemory, config.numThreads);
+		}));
+
+		ol::LabMemorySink memorySink;
+		toMemory.seconds.push_back(timeIt([&]()
+		{
+			ok = ok && memoryWriter.write(memorySink);
+		}));
+
+		if (!ok)
+		{
+			std::cerr << "Failed to write the benchmark archive!\n";
+			return false;
+		}
+		archiveBytes = memorySink.getBuffer().size();
+	}
+
+	toFile.bytesPerOp   = archiveBytes;
+	toMemory.bytesPerOp = archiveBytes;
+
+	results.push_back(std::move(toFile));
+	results.push_back(std::move(toMemory));
+	return true;
+}
+
+static bool benchOpen(const BenchConfig & config, const std::string & labFile, const std::uint64_t archiveBytes,
+                      std::vector<BenchResult> & results)
+{
+	struct { const char * name; ol::LabArchiveReader::OpenMode mode; } const modes[] = {
+		{ "open_load_whole_file", ol::LabArchiveReader::OpenMode::LoadWholeFile },
+		{ "open_memory_mapped",   ol::LabArchiveReader::OpenMode::MemoryMapped  },
+		{ "open_metadata_only",   ol::LabArchiveReader::OpenMode::MetadataOnly  }
+	};
+
+	for (const auto & mode : modes)
+	{
+		BenchResult result;
+		result.name = mode.name;
+		if (mode.mode == ol::LabArchiveReader::OpenMode::LoadWholeFile)
+		{
+			result.bytesPerOp = archiveBytes;
+		}
+
+		for (int i = 0; i < config.iterations; ++i)
+		{
+			ol::LabArchiveReader labReader{ labFile, mode.mode };
+			bool opened = false;
+			result.seconds.push_back(timeIt([&]() { opened = labReader.open(); }));
+
+			if (!opened)
+			{
+				std::cerr << "Failed to open the benchmark archive!\n";
+				return false;
+			}
+		}
+		results.push_back(std::move(result));
+	}
+	return true;
+}
+
+static void benchLookups(const BenchConfig & config, const std::vector<CorpusEntry> & corpus,
+                         const ol::LabArchiveReader & labReader, std::vector<BenchResult> & results)
+{
+	// A single lookup is close to the clock resolution, so time them in batches,
+	// rounding the lookup count up to whole batches.
+	const std::size_t batchSize  = 256;
+	const std::size_t batchCount = (config.lookups + batchSize - 1) / batchSize;
+	const std::size_t lookups    = batchCount * batchSize;
+
+	std::mt19937 rng{ config.seed + 1 };
+	std::uniform_int_distribution<std::size_t> pick{ 0, corpus.size() - 1 };
+
+	// Hits with the stored names, misses with names that differ only at the end.
+	std::vector<std::string> hitNames(lookups);
+	std::vector<std::string> missNames(lookups);
+	for (std::size_t i = 0; i < lookups; ++i)
+	{
+		hitNames[i]  = corpus[pick(rng)].name;
+		missNames[i] = corpus[pick(rng)].name + "_";
+	}
+
+	BenchResult hits;
+	hits.name = "lookup_hit";
+	hits.opsPerSample = batchSize;
+	hits.seconds.reserve(batchCount);
+
+	BenchResult misses;
+	misses.name = "lookup_miss";
+	misses.opsPerSample = batchSize;
+	misses.seconds.reserve(batchCount);
+
+	std::size_t found = 0;
+	for (std::size_t b = 0; b < lookups; b += batchSize)
+	{
+		hits.seconds.push_back(timeIt([&]()
+		{
+			for (std::size_t i = b; i < b + batchSize; ++i)
+			{
+				found += (labReader.findEntry(hitNames[i]) != ol::LabArchiveReader::EntryNotFound);
+			}
+		}) / batchSize);
+
+		misses.seconds.push_back(timeIt([&]()
+		{
+			for (std::size_t i = b; i < b + batchSize; ++i)
+			{
+				found += (labReader.findEntry(missNames[i]) != ol::LabArchiveReader::EntryNotFound);
+			}
+		}) / batchSize);
+	}
+
+	if (found != lookups)
+	{
+		std::cerr << "Warning: " << found << " of " << lookups << " lookups found their entry!\n";
+	}
+
+	results.push_back(std::move(hits));
+	results.push_back(std::move(misses));
+}
+
+static bool benchReads(const BenchConfig & config, const std::string & labFile, std::vector<BenchResult> & results)
+{
+	ol::LabArchiveReader labReader{ labFile, ol::LabArchiveReader::OpenMode::MetadataOnly };
+	if (!labReader.open())
+	{
+		return false;
+	}
+
+	std::mt19937 rng{ config.seed + 2 };
+	std::uniform_int_distribution<std::size_t> pick{ 0, labReader.getEntryCount() - 1 };
+	std::vector<std::uint8_t> buffer(config.maxSize);
+
+	BenchResult reads;
+	reads.name = "read_entry";
+	reads.seconds.reserve(config.lookups);
+
+	std::uint64_t bytesRead = 0;
+	for (std::size_t i = 0; i < config.lookups; ++i)
+	{
+		const std::size_t index = pick(rng);
+		bool ok = false;
+		reads.seconds.push_back(timeIt([&]() { ok = labReader.readEntry(index, buffer.data(), buffer.size()); }));
+
+		if (!ok)
+		{
+			return false;
+		}
+		bytesRead += labReader.getEntrySize(index);
+	}
+
+	// Average entry size, so throughput comes out right.
+	reads.bytesPerOp = bytesRead / std::max<std::size_t>(config.lookups, 1);
+	results.push_back(std::move(reads));
+	return true;
+}
+
+static bool benchExtract(const BenchConfig & config, const std::string & labFile, const std::uint64_t corpusBytes,
+                         std::vector<BenchResult> & results)
+{
+	ol::LabArchiveReader labReader{ labFile, ol::LabArchiveReader::OpenMode::MemoryMapped };
+	if (!labReader.open())
+	{
+		return false;
+	}
+
+	BenchResult result;
+	result.name = "extract_whole_archive";
+	result.bytesPerOp = corpusBytes;
+
+	const std::string destPath = config.workDir + "extracted/";
+	for (int i = 0; i < config.iterations; ++i)
+	{
+		int extracted = 0;
+		result.seconds.push_back(timeIt([&]() { extracted = labReader.extractWholeArchive(destPath, config.numThreads); }));
+
+		if (extracted != static_cast<int>(labReader.getEntryCount()))
+		{
+			std::cerr << "Only extracted " << extracted << " of " << labReader.getEntryCount() << " entries!\n";
+			return false;
+		}
+	}
+
+	results.push_back(std::move(result));
+	return true;
+}
+
+// ========================================================
+// Reporting:
+// ========================================================
+
+static void printResults(std::ostream & os, const std::vector<BenchResult> & results)
+{
+	os << std::left << std::setw(24) << "benchmark" << std::right
+	   << std::setw(10) << "samples" << std::setw(14) << "p50 (us)" << std::setw(14) << "p99 (us)"
+	   << std::setw(16) << "ops/s" << std::setw(12) << "MB/s" << "\n";
+
+	os << std::fixed;
+	for (const auto & result : results)
+	{
+		os << std::left << std::setw(24) << result.name << std::right
+		   << std::setw(10) << result.seconds.size()
+		   << std::setw(14) << std::setprecision(3) << result.percentile(0.50) * 1e6
+		   << std::setw(14) << std::setprecision(3) << result.percentile(0.99) * 1e6
+		   << std::setw(16) << std::setprecision(1) << result.opsPerSecond();
+
+		if (result.bytesPerOp != 0)
+		{
+			os << std::setw(12) << std::setprecision(1) << result.megabytesPerSecond();
+		}
+		else
+		{
+			os << std::setw(12) << "-";
+		}
+		os << "\n";
+	}
+	os << std::defaultfloat;
+}
+
+static bool writeJson(std::ostream & os, const BenchConfig & config, const std::uint64_t corpusBytes,
+                      const std::uint64_t archiveBytes, const std::vector<BenchResult> & results)
+{
+	os << "{\n";
+	os << "  \"config\": {\n";
+	os << "    \"entries\": " << config.entryCount << ",\n";
+	os << "    \"min_size\": " << config.minSize << ",\n";
+	os << "    \"max_size\": " << config.maxSize << ",\n";
+	os << "    \"size_distribution\": \"" << (config.logSizes ? "log" : "uniform") << "\",\n";
+	os << "    \"iterations\": " << config.iterations << ",\n";
+	os << "    \"lookups\": " << config.lookups << ",\n";
+	os << "    \"threads\": " << config.numThreads << ",\n";
+	os << "    \"seed\": " << config.seed << ",\n";
+	os << "    \"corpus_bytes\": " << corpusBytes << ",\n";
+	os << "    \"archive_bytes\": " << archiveBytes << "\n";
+	os << "  },\n";
+	os << "  \"results\": [\n";
+
+	os << std::setprecision(9);
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		const auto & result = results[i];
+		os << "    { \"name\": \"" << result.name << "\""
+		   << ", \"samples\": " << result.seconds.size()
+		   << ", \"ops_per_sample\": " << result.opsPerSample
+		   << ", \"p50_us\": " << result.percentile(0.50) * 1e6
+		   << ", \"p99_us\": " << result.percentile(0.99) * 1e6
+		   << ", \"total_s\": " << result.total()
+		   << ", \"ops_per_sec\": " << result.opsPerSecond()
+		   << ", \"mb_per_sec\": " << result.megabytesPerSecond()
+		   << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	os << "  ]\n";
+	os << "}\n";
+	return os.good();
+}
+
+// ========================================================
+// main():
+// ========================================================
+
+int main(int argc, const char * argv[])
+{
+	BenchConfig config;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char * value = nullptr;
+		if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0)
+		{
+			// Printing help is not treated as an error.
+			printHelpText(argv[0]);
+			return EXIT_SUCCESS;
+		}
+		else if (std::strcmp(argv[i], "-n") == 0 || std::strcmp(argv[i], "--entries") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			std::uint64_t count = 0;
+			if (!parseNumber(value, 10000000, count))
+			{
+				std::cerr << "Invalid number of entries " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			config.entryCount = static_cast<std::size_t>(count);
+		}
+		else if (std::strcmp(argv[i], "--sizes") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			// Entry sizes are 32-bits in a LAB.
+			const char * sep = nullptr;
+			std::uint64_t minSize = 0;
+			std::uint64_t maxSize = 0;
+			if (!parseNumber(value, UINT32_MAX, minSize, &sep) || *sep != ':' ||
+			    !parseNumber(sep + 1, UINT32_MAX, maxSize))
+			{
+				std::cerr << "Invalid entry sizes " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			config.minSize = static_cast<std::size_t>(minSize);
+			config.maxSize = static_cast<std::size_t>(maxSize);
+		}
+		else if (std::strcmp(argv[i], "--dist") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			if (std::strcmp(value, "log") != 0 && std::strcmp(value, "uniform") != 0)
+			{
+				std::cerr << "Unknown size distribution " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			config.logSizes = (std::strcmp(value, "log") == 0);
+		}
+		else if (std::strcmp(argv[i], "-i") == 0 || std::strcmp(argv[i], "--iterations") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			std::uint64_t iterations = 0;
+			if (!parseNumber(value, 10000, iterations))
+			{
+				std::cerr << "Invalid number of iterations " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			config.iterations = static_cast<int>(iterations);
+		}
+		else if (std::strcmp(argv[i], "--lookups") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			std::uint64_t lookups = 0;
+			if (!parseNumber(value, 100000000, lookups))
+			{
+				std::cerr << "Invalid number of lookups " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			config.lookups = static_cast<std::size_t>(lookups);
+		}
+		else if (std::strcmp(argv[i], "-j") == 0 || std::strcmp(argv[i], "--jobs") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			std::uint64_t jobs = 0;
+			if (!parseNumber(value, 4096, jobs))
+			{
+				std::cerr << "Invalid number of jobs " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			config.numThreads = static_cast<int>(jobs);
+		}
+		else if (std::strcmp(argv[i], "--seed") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			std::uint64_t seed = 0;
+			if (!parseNumber(value, UINT32_MAX, seed))
+			{
+				std::cerr << "Invalid seed " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			config.seed = static_cast<unsigned>(seed);
+		}
+		else if (std::strcmp(argv[i], "-d") == 0 || std::strcmp(argv[i], "--dir") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			config.workDir   = value;
+			config.keepFiles = true;
+			if (config.workDir.back() != ol::filesys::getPathSeparator()[0])
+			{
+				config.workDir += ol::filesys::getPathSeparator();
+			}
+		}
+		else if (std::strcmp(argv[i], "--json") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			config.jsonFile = value;
+		}
+		else
+		{
+			std::cerr << "Unknown argument " << argv[i] << "!\n";
+			printHelpText(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (config.entryCount == 0 || config.iterations <= 0 || config.lookups == 0 ||
+	    config.minSize == 0 || config.maxSize < config.minSize)
+	{
+		std::cerr << "Invalid benchmark parameters!\n";
+		return EXIT_FAILURE;
+	}
+
+	// Human-readable output goes to STDERR if the JSON goes to STDOUT.
+	std::ostream & out = (config.jsonFile == "-") ? std::cerr : std::cout;
+
+	std::uint64_t corpusBytes = 0;
+	const auto corpus = generateCorpus(config, corpusBytes);
+	out << "Corpus: " << corpus.size() << " entries, " << corpusBytes << " bytes ("
+	    << (config.logSizes ? "log" : "uniform") << " sizes " << config.minSize << " to " << config.maxSize << ").\n";
+
+	ol::filesys::createPath(config.workDir);
+	const std::string labFile = config.workDir + "bench.lab";
+
+	// Cleans up on every return from here on, failed runs included.
+	struct BenchFilesGuard
+	{
+		const BenchConfig & config;
+		const std::vector<CorpusEntry> & corpus;
+		~BenchFilesGuard()
+		{
+			if (!config.keepFiles)
+			{
+				removeBenchFiles(config.workDir, corpus);
+			}
+		}
+	} benchFilesGuard{ config, corpus };
+
+	// Writing first also leaves the archive the other benchmarks read.
+	std::vector<BenchResult> results;
+	std::uint64_t archiveBytes = 0;
+
+	if (!benchWrite(config, corpus, labFile, archiveBytes, results))
+	{
+		return EXIT_FAILURE;
+	}
+
+	if (!benchOpen(config, labFile, archiveBytes, results))
+	{
+		return EXIT_FAILURE;
+	}
+
+	{
+		ol::LabArchiveReader labReader{ labFile, ol::LabArchiveReader::OpenMode::MetadataOnly };
+		if (!labReader.open())
+		{
+			return EXIT_FAILURE;
+		}
+		benchLookups(config, corpus, labReader, results);
+	}
+
+	if (!benchReads(config, labFile, results) || !benchExtract(config, labFile, corpusBytes, results))
+	{
+		std::cerr << "Failed to read back the benchmark archive!\n";
+		return EXIT_FAILURE;
+	}
+
+	printResults(out, results);
+
+	if (config.jsonFile == "-")
+	{
+		writeJson(std::cout, config, corpusBytes, archiveBytes, results);
+	}
+	else if (!config.jsonFile.empty())
+	{
+		std::ofstream jsonOut{ config.jsonFile };
+		if (!jsonOut || !writeJson(jsonOut, config, corpusBytes, archiveBytes, results))
+		{
+			std::cerr << "Failed to write JSON results to " << config.jsonFile << "!\n";
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
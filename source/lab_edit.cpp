@@ -0,0 +1,135 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_edit.cpp
+// Created on: 16/10/26
+// Brief: Command line tool to add, replace or remove entries of an existing LucasArts LAB archive.
+// ================================================================================================
+
+#include "ol/lab_archive_editor.hpp"
+
+#include <string>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+static void printHelpText(const char * progName)
+{
+	std::cout
+		<< "\n"
+		<< "Usage:\n"
+		<< "$ " << progName << " <lab_file> [commands...] [--verbose | -v]\n"
+		<< "  Edits the LAB archive in place. Commands run in order and are committed together:\n"
+		<< "    --add | -a <entry_name> <source_file>      Add a new entry with the file's contents.\n"
+		<< "    --replace | -r <entry_name> <source_file>  Replace the contents of an existing entry.\n"
+		<< "    --remove | -d <entry_name>                 Remove an entry.\n"
+		<< "    --compact | -c                             Rewrite the archive without dead space.\n"
+		<< "  Only the changed data and the entry table are written, unless --compact is given.\n"
+		<< "  If the --verbose|-v flag is provided, prints the archive size and dead space to STDOUT.\n"
+		<< "\n"
+		<< "Usage:\n"
+		<< "$ " << progName << " --help | -h\n"
+		<< "  Prints this help text.\n"
+		<< "\n";
+}
+
+// Value following the flag at argv[i], advancing i. Null if missing.
+static const char * getFlagValue(const int argc, const char * argv[], int & i)
+{
+	if (i + 1 >= argc)
+	{
+		std::cerr << "Missing value after " << argv[i] << "!\n";
+		return nullptr;
+	}
+	return argv[++i];
+}
+
+int main(int argc, const char * argv[])
+{
+	// At least the program name and source file/help-flag.
+	if (argc < 2)
+	{
+		std::cerr << "Not enough arguments!\n";
+		printHelpText(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Printing help is not treated as an error.
+	if (std::strcmp(argv[1], "-h") == 0 || std::strcmp(argv[1], "--help") == 0)
+	{
+		printHelpText(argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	bool verbose = false;
+	for (int i = 2; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "-v") == 0 || std::strcmp(argv[i], "--verbose") == 0)
+		{
+			verbose = true;
+		}
+	}
+
+	ol::LabArchiveEditor labEditor { argv[1] };
+	if (!labEditor.open())
+	{
+		std::cerr << "Unable to open the specified LAB archive!\n";
+		return EXIT_FAILURE;
+	}
+
+	bool compact = false;
+	for (int i = 2; i < argc; ++i)
+	{
+		const bool add     = (std::strcmp(argv[i], "-a") == 0 || std::strcmp(argv[i], "--add") == 0);
+		const bool replace = (std::strcmp(argv[i], "-r") == 0 || std::strcmp(argv[i], "--replace") == 0);
+
+		bool ok = true;
+		if (add || replace)
+		{
+			const char * entryName  = getFlagValue(argc, argv, i);
+			const char * sourceFile = (entryName != nullptr) ? getFlagValue(argc, argv, i) : nullptr;
+			if (sourceFile == nullptr) { return EXIT_FAILURE; }
+
+			ok = replace ? labEditor.replaceEntryFromFile(entryName, sourceFile) :
+			               labEditor.addEntryFromFile(entryName, sourceFile);
+		}
+		else if (std::strcmp(argv[i], "-d") == 0 || std::strcmp(argv[i], "--remove") == 0)
+		{
+			const char * entryName = getFlagValue(argc, argv, i);
+			if (entryName == nullptr) { return EXIT_FAILURE; }
+
+			ok = labEditor.removeEntry(entryName);
+		}
+		else if (std::strcmp(argv[i], "-c") == 0 || std::strcmp(argv[i], "--compact") == 0)
+		{
+			compact = true;
+		}
+		else if (std::strcmp(argv[i], "-v") != 0 && std::strcmp(argv[i], "--verbose") != 0)
+		{
+			std::cerr << "Unknown argument " << argv[i] << "!\n";
+			std::cerr << "No changes were committed to the LAB archive.\n";
+			return EXIT_FAILURE;
+		}
+
+		// Nothing is committed if any command fails.
+		if (!ok)
+		{
+			std::cerr << "No changes were committed to the LAB archive.\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!labEditor.commit() || (compact && !labEditor.compact()))
+	{
+		std::cerr << "Failed to update the LAB archive!\n";
+		return EXIT_FAILURE;
+	}
+
+	if (verbose)
+	{
+		std::cout << "Entries:    " << labEditor.getEntryCount() << "\n";
+		std::cout << "File size:  " << labEditor.getFileSize() << " bytes\n";
+		std::cout << "Dead space: " << labEditor.getDeadSpace() << " bytes\n";
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,482 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_gen.cpp
+// Created on: 16/10/26
+// Brief: Generates large synthetic LAB archives, optionally corrupted, for scale testing.
+// ================================================================================================
+
+#include "ol/filesys_utils.hpp"
+#include "ol/lab_archive_writer.hpp"
+#include "ol/lab_common.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+enum class CorruptMode
+{
+	None,
+	BadNameOffset, // nameOffset past the end of the name list.
+	BadDataOffset, // dataOffset past the end of the archive.
+	BadSize        // dataOffset is fine, but the data runs past the end of the archive.
+};
+
+struct GenConfig
+{
+	std::string   outputLab;            // "-" for STDOUT.
+	std::size_t   entryCount   = 10000;
+	std::uint64_t totalSize    = 64 * 1024 * 1024;
+	std::size_t   nameLength   = 0;     // Pad names to at least this many chars, zero for natural lengths.
+	unsigned      seed         = 1234;
+	CorruptMode   corruptMode  = CorruptMode::None;
+	std::size_t   corruptCount = 1;
+	bool          verbose      = false;
+};
+
+static void printHelpText(const char * progName)
+{
+	std::cout
+		<< "\n"
+		<< "Usage:\n"
+		<< "$ " << progName << " <output_lab | -> [--entries | -n <N>] [--total-size | -t <bytes>]\n"
+		<< "  [--name-length | -l <N>] [--seed <N>] [--corrupt <mode>] [--corrupt-count <N>] [-v]\n"
+		<< "  Writes a synthetic LAB archive of N entries (default 10000) whose data adds up to the\n"
+		<< "  total size (default 64M; K, M and G suffixes are accepted, the format is limited to 4G).\n"
+		<< "  Entry sizes are log-uniformly distributed and names get a weighted mix of the Outlaws\n"
+		<< "  extensions, so the 4CC type ids look like those of the game archives. Entry data is\n"
+		<< "  pseudo-random and produced while writing; nothing is staged on disk. Output \"-\" writes\n"
+		<< "  the archive to STDOUT.\n"
+		<< "  --name-length|-l pads every name to at least N characters (at most 4096).\n"
+		<< "  --seed sets the random seed; the same parameters and seed give the same archive.\n"
+		<< "  --corrupt damages entries of the archive after writing it, to test readers. Modes:\n"
+		<< "    bad-name-offset: name offset past the end of the name list.\n"
+		<< "    bad-data-offset: data offset past the end of the archive.\n"
+		<< "    bad-size:        entry data running past the end of the archive.\n"
+		<< "  --corrupt-count sets how many random entries to damage (default 1). Needs a file output.\n"
+		<< "  -v prints statistics (to STDERR if the archive goes to STDOUT).\n"
+		<< "\n"
+		<< "Usage:\n"
+		<< "$ " << progName << " --help | -h\n"
+		<< "  Prints this help text.\n"
+		<< "\n";
+}
+
+// Value following the flag at argv[i], advancing i. Null if missing.
+static const char * getFlagValue(const int argc, const char * argv[], int & i)
+{
+	if (i + 1 >= argc)
+	{
+		std::cerr << "Missing value after " << argv[i] << "!\n";
+		return nullptr;
+	}
+	return argv[++i];
+}
+
+// Decimal count no greater than maxValue, with nothing after it. False if malformed.
+// strtoull() would quietly negate a leading minus sign, so only digits are accepted.
+static bool parseCount(const char * str, const std::uint64_t maxValue, std::uint64_t & count)
+{
+	if (*str < '0' || *str > '9')
+	{
+		return false;
+	}
+
+	char * end = nullptr;
+	count = std::strtoull(str, &end, 10);
+	return *end == '\0' && count <= maxValue;
+}
+
+// Byte count with an optional K, M or G suffix (powers of 1024). False if malformed.
+static bool parseByteCount(const char * str, std::uint64_t & bytes)
+{
+	if (*str < '0' || *str > '9')
+	{
+		return false;
+	}
+
+	char * end = nullptr;
+	bytes = std::strtoull(str, &end, 10);
+	if (end == str)
+	{
+		return false;
+	}
+
+	switch (*end)
+	{
+	case 'k' : case 'K' : bytes <<= 10; ++end; break;
+	case 'm' : case 'M' : bytes <<= 20; ++end; break;
+	case 'g' : case 'G' : bytes <<= 30; ++end; break;
+	default  : break;
+	} // switch (*end)
+
+	return *end == '\0';
+}
+
+// ========================================================
+// Synthetic entries:
+// ========================================================
+
+// Rough proportions of the file types in the Outlaws archives.
+// Extensions without a known 4CC get a zero type id, like some real entries.
+struct ExtensionWeight
+{
+	const char * ext;
+	double       weight;
+};
+
+static const ExtensionWeight extensionMix[] = {
+	{ ".pcx", 30.0 }, { ".wav", 18.0 }, { ".nwx", 12.0 }, { ".itm", 7.0 },
+	{ ".atx", 6.0  }, { ".3do", 5.0  }, { ".phy", 4.0  }, { ".msc", 3.0 },
+	{ ".rcs", 3.0  }, { ".inf", 3.0  }, { ".lvt", 3.0  }, { ".obt", 2.0 },
+	{ ".laf", 2.0  }, { ".msg", 1.0  }, { ".txt", 1.0  }
+};
+
+static const char * const directoryNames[] = {
+	"textures", "sounds", "sprites", "items", "levels",
+	"models", "physics", "scripts", "fonts", "ui"
+};
+
+static std::vector<std::size_t> generateSizes(const GenConfig & config, std::mt19937 & rng)
+{
+	// Log-uniform weights over three decades: many small entries, a few big ones.
+	std::uniform_real_distribution<double> unit{ 0.0, 1.0 };
+	std::vector<double> weights(config.entryCount);
+	double weightSum = 0.0;
+
+	for (auto & w : weights)
+	{
+		w = std::exp(unit(rng) * std::log(1000.0));
+		weightSum += w;
+	}
+
+	// Scale to the total size, then hand the rounding leftover out one byte per entry.
+	std::vector<std::size_t> sizes(config.entryCount);
+	std::uint64_t assigned = 0;
+
+	for (std::size_t i = 0; i < sizes.size(); ++i)
+	{
+		sizes[i] = static_cast<std::size_t>(double(config.totalSize) * (weights[i] / weightSum));
+		assigned += sizes[i];
+	}
+	for (std::size_t i = 0; assigned < config.totalSize; i = (i + 1) % sizes.size(), ++assigned)
+	{
+		++sizes[i];
+	}
+	return sizes;
+}
+
+static std::string generateName(const GenConfig & config, const std::size_t index, const char * ext, std::mt19937 & rng)
+{
+	const std::size_t dirCount = sizeof(directoryNames) / sizeof(directoryNames[0]);
+
+	// The index keeps names unique; the rest is just there to look plausible.
+	std::ostringstream name;
+	name << directoryNames[index % dirCount] << "\\set" << ((index / dirCount) % 64) << "\\"
+	     << std::hex << std::setw(8) << std::setfill('0') << index;
+
+	std::string str = name.str();
+	const std::size_t extLen = std::strlen(ext);
+	if (str.length() + extLen < config.nameLength)
+	{
+		std::uniform_int_distribution<int> letter{ 'a', 'z' };
+		str.push_back('_');
+		while (str.length() + extLen < config.nameLength)
+		{
+			str.push_back(static_cast<char>(letter(rng)));
+		}
+	}
+	return str + ext;
+}
+
+static bool addEntries(const GenConfig & config, ol::LabArchiveWriter & labWriter)
+{
+	std::mt19937 rng{ config.seed };
+	const auto sizes = generateSizes(config, rng);
+
+	std::vector<double> weights;
+	for (const auto & mix : extensionMix)
+	{
+		weights.push_back(mix.weight);
+	}
+	std::discrete_distribution<std::size_t> pickExtension{ weights.begin(), weights.end() };
+
+	for (std::size_t i = 0; i < config.entryCount; ++i)
+	{
+		const std::string name = generateName(config, i, extensionMix[pickExtension(rng)].ext, rng);
+
+		// Cheap xorshift fill, a word at a time. Contents don't matter,
+		// but shouldn't be all zeros or compress to nothing.
+		std::uint32_t state = static_cast<std::uint32_t>(rng()) | 1;
+		auto reader = [state](void * dest, const std::size_t maxBytes) mutable -> std::size_t
+		{
+			auto * bytes = static_cast<std::uint8_t *>(dest);
+			for (std::size_t n = 0; n < maxBytes; n += sizeof(state))
+			{
+				state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+				std::memcpy(bytes + n, &state, std::min(sizeof(state), maxBytes - n));
+			}
+			return maxBytes;
+		};
+
+		if (!labWriter.addStream(name, sizes[i], std::move(reader)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// ========================================================
+// Corruption:
+// ========================================================
+
+static bool corruptArchive(const GenConfig & config, std::ostream & out)
+{
+	std::size_t fileSize = 0;
+	if (!ol::filesys::queryFileSize(config.outputLab, fileSize))
+	{
+		std::cerr << "Can't query the size of " << config.outputLab << "!\n";
+		return false;
+	}
+
+	FILE * labFile = std::fopen(config.outputLab.c_str(), "r+b");
+	if (labFile == nullptr)
+	{
+		std::cerr << "Can't reopen " << config.outputLab << " to corrupt it!\n";
+		return false;
+	}
+
+	ol::LabHeader header;
+	if (!ol::filesys::readFileAt(labFile, 0, &header, sizeof(header)) || header.fileCount == 0)
+	{
+		std::cerr << "Can't read back the header of " << config.outputLab << "!\n";
+		std::fclose(labFile);
+		return false;
+	}
+
+	// Different seed than the generator, so the damaged entries don't follow the sizes.
+	std::mt19937 rng{ config.seed ^ 0x9E3779B9u };
+	std::uniform_int_distribution<std::uint32_t> pickEntry{ 0, header.fileCount - 1 };
+	std::unordered_set<std::uint32_t> corrupted;
+
+	const std::size_t count = std::min<std::size_t>(config.corruptCount, header.fileCount);
+	const auto maxOffset = std::numeric_limits<std::uint32_t>::max();
+	bool ok = true;
+
+	while (ok && corrupted.size() < count)
+	{
+		const std::uint32_t index = pickEntry(rng);
+		if (!corrupted.insert(index).second)
+		{
+			continue;
+		}
+
+		const std::uint64_t entryOffset = sizeof(ol::LabHeader) + std::uint64_t(index) * sizeof(ol::LabFileEntry);
+		ol::LabFileEntry entry;
+		ok = ol::filesys::readFileAt(labFile, entryOffset, &entry, sizeof(entry));
+		if (!ok)
+		{
+			break;
+		}
+
+		switch (config.corruptMode)
+		{
+		case CorruptMode::BadNameOffset :
+			entry.nameOffset = header.fileNameListLength + (rng() % 1024);
+			break;
+		case CorruptMode::BadDataOffset :
+			entry.dataOffset = static_cast<std::uint32_t>(std::min<std::uint64_t>(std::uint64_t(fileSize) + 1 + (rng() % 1024), maxOffset));
+			break;
+		case CorruptMode::BadSize :
+			entry.sizeInBytes = static_cast<std::uint32_t>(std::min<std::uint64_t>(fileSize - entry.dataOffset + 1 + (rng() % 1024), maxOffset));
+			break;
+		default :
+			break;
+		} // switch (config.corruptMode)
+
+		ok = ol::filesys::writeFileAt(labFile, entryOffset, &entry, sizeof(entry));
+		if (ok && config.verbose)
+		{
+			out << "Corrupted entry #" << index << ".\n";
+		}
+	}
+
+	ok = (std::fclose(labFile) == 0) && ok;
+	if (!ok)
+	{
+		std::cerr << "Failed to corrupt entries of " << config.outputLab << "!\n";
+	}
+	return ok;
+}
+
+// ========================================================
+// main():
+// ========================================================
+
+int main(int argc, const char * argv[])
+{
+	GenConfig config;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char * value = nullptr;
+		if (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0)
+		{
+			// Printing help is not treated as an error.
+			printHelpText(argv[0]);
+			return EXIT_SUCCESS;
+		}
+		else if (std::strcmp(argv[i], "-n") == 0 || std::strcmp(argv[i], "--entries") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			std::uint64_t count = 0;
+			if (!parseCount(value, std::numeric_limits<std::uint32_t>::max(), count))
+			{
+				std::cerr << "Invalid number of entries " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			config.entryCount = static_cast<std::size_t>(count);
+		}
+		else if (std::strcmp(argv[i], "-t") == 0 || std::strcmp(argv[i], "--total-size") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			if (!parseByteCount(value, config.totalSize))
+			{
+				std::cerr << "Bad byte count " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (std::strcmp(argv[i], "-l") == 0 || std::strcmp(argv[i], "--name-length") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			std::uint64_t length = 0;
+			if (!parseCount(value, 4096, length))
+			{
+				std::cerr << "Invalid name length " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			config.nameLength = static_cast<std::size_t>(length);
+		}
+		else if (std::strcmp(argv[i], "--seed") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			std::uint64_t seed = 0;
+			if (!parseCount(value, std::numeric_limits<std::uint32_t>::max(), seed))
+			{
+				std::cerr << "Invalid seed " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			config.seed = static_cast<unsigned>(seed);
+		}
+		else if (std::strcmp(argv[i], "--corrupt") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			if      (std::strcmp(value, "bad-name-offset") == 0) { config.corruptMode = CorruptMode::BadNameOffset; }
+			else if (std::strcmp(value, "bad-data-offset") == 0) { config.corruptMode = CorruptMode::BadDataOffset; }
+			else if (std::strcmp(value, "bad-size")        == 0) { config.corruptMode = CorruptMode::BadSize;       }
+			else
+			{
+				std::cerr << "Unknown corruption mode " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+		}
+		else if (std::strcmp(argv[i], "--corrupt-count") == 0)
+		{
+			if ((value = getFlagValue(argc, argv, i)) == nullptr) { return EXIT_FAILURE; }
+			std::uint64_t count = 0;
+			if (!parseCount(value, std::numeric_limits<std::uint32_t>::max(), count))
+			{
+				std::cerr << "Invalid corrupt count " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			config.corruptCount = static_cast<std::size_t>(count);
+		}
+		else if (std::strcmp(argv[i], "-v") == 0 || std::strcmp(argv[i], "--verbose") == 0)
+		{
+			config.verbose = true;
+		}
+		else if (config.outputLab.empty() && (argv[i][0] != '-' || std::strcmp(argv[i], "-") == 0))
+		{
+			config.outputLab = argv[i];
+		}
+		else
+		{
+			std::cerr << "Unknown argument " << argv[i] << "!\n";
+			printHelpText(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	const bool toStdout = (config.outputLab == "-");
+	if (config.outputLab.empty() || config.entryCount == 0 ||
+	    config.entryCount > std::numeric_limits<std::uint32_t>::max())
+	{
+		std::cerr << "Invalid generator parameters!\n";
+		printHelpText(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (config.totalSize > std::numeric_limits<std::uint32_t>::max())
+	{
+		std::cerr << "Total size exceeds the 4GB limit of the LAB format!\n";
+		return EXIT_FAILURE;
+	}
+	if (config.corruptMode != CorruptMode::None && toStdout)
+	{
+		std::cerr << "Corrupting entries needs a file output, not STDOUT!\n";
+		return EXIT_FAILURE;
+	}
+
+	// Human-readable output goes to STDERR if the archive goes to STDOUT.
+	std::ostream & out = toStdout ? std::cerr : std::cout;
+
+	ol::LabArchiveWriter labWriter;
+	if (!addEntries(config, labWriter))
+	{
+		return EXIT_FAILURE;
+	}
+
+	// Streams are produced in order, so writing is always serial.
+	bool ok;
+	if (toStdout)
+	{
+		ol::filesys::setBinaryMode(stdout);
+		std::fflush(stdout);
+
+		ol::LabFdSink sink{ fileno(stdout) };
+		ok = labWriter.write(sink, ol::LabArchiveWriter::WriteMode::Streaming);
+	}
+	else
+	{
+		ol::LabFileSink sink{ config.outputLab };
+		ok = sink.open() && labWriter.write(sink, ol::LabArchiveWriter::WriteMode::Streaming);
+	}
+
+	if (!ok)
+	{
+		std::cerr << "Failed to generate LAB archive " << config.outputLab << "!\n";
+		return EXIT_FAILURE;
+	}
+
+	if (config.verbose)
+	{
+		out << "Generated " << (toStdout ? "STDOUT" : config.outputLab) << ": " << labWriter.getEntryCount()
+		    << " entries, " << config.totalSize << " bytes of data.\n";
+	}
+
+	if (config.corruptMode != CorruptMode::None && !corruptArchive(config, out))
+	{
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -7,20 +7,41 @@
 // Brief: Simple command line tool to pack files into LucasArts LAB archives.
 // ================================================================================================
 
+#include "ol/crc32c.hpp"
 #include "ol/filesys_utils.hpp"
+#include "ol/lab_archive_reader.hpp"
 #include "ol/lab_archive_writer.hpp"
+#include "ol/lab_build_manifest.hpp"
 
+#include <algorithm>
 #include <string>
 #include <iostream>
+#include <vector>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 static void printHelpText(const char * progName)
 {
 	std::cout
 		<< "\n"
 		<< "Usage:\n"
-		<< "$ " << progName << " <input_dir> <output_lab> [--verbose | -v]\n"
-		<< "  Packs each file in the provided directory path into a single LAB archive.\n"
+		<< "$ " << progName << " <input_dir> <output_lab> [--stream | -s] [--jobs | -j <N>] [--dedup | -d]\n"
+		<< "  [--align | -a <bytes>] [--order | -o <order_file>] [--incremental | -i] [--verbose | -v]\n"
+		<< "  Packs each file in the provided directory tree into a single LAB archive.\n"
+		<< "  Files in subdirectories are stored with relative names, e.g. \"sounds\\door.wav\".\n"
+		<< "  If the --stream|-s flag is provided, files are copied straight into the archive\n"
+		<< "  instead of being loaded into memory first. Use it for very big LABs.\n"
+		<< "  If --jobs|-j is given, N threads copy files into the preallocated archive in parallel.\n"
+		<< "  Zero means one thread per CPU core. Files are always streamed in this mode.\n"
+		<< "  If --dedup|-d is given, byte-identical files are stored once and share their data.\n"
+		<< "  If --align|-a is given, the data of each entry starts at a multiple of that many bytes.\n"
+		<< "  Use 4096 for page-aligned entries that can be memory mapped individually.\n"
+		<< "  If --order|-o is given, entry data is laid out in the order the file lists the entry names,\n"
+		<< "  one per line, like an access trace saved by LabArchiveReader. Unlisted files go last.\n"
+		<< "  If --incremental|-i is given, a manifest is kept next to the archive (<output_lab>.manifest)\n"
+		<< "  and the next run with -i only repacks what changed: nothing at all if no file did, otherwise\n"
+		<< "  unchanged entries are copied straight from the previous archive instead of their source files.\n"
 		<< "  If the --verbose|-v flag is provided, prints miscellaneous running stats to STDOUT.\n"
 		<< "\n"
 		<< "Usage:\n"
@@ -29,6 +50,221 @@ static void printHelpText(const char * progName)
 		<< "\n";
 }
 
+// Value following the flag at argv[i], advancing i. Null if missing.
+static const char * getFlagValue(const int argc, const char * argv[], int & i)
+{
+	if (i + 1 >= argc)
+	{
+		std::cerr << "Missing value after " << argv[i] << "!\n";
+		return nullptr;
+	}
+	return argv[++i];
+}
+
+// Fills in the manifest checksums and offsets of a freshly written archive,
+// dropping entries the writer left out, then records the archive itself.
+static bool updateManifest(ol::LabBuildManifest & manifest, const std::vector<char> & checksumKnown,
+                           const std::string & outputLab)
+{
+	ol::LabArchiveReader labReader { outputLab, ol::LabArchiveReader::OpenMode::MetadataOnly };
+	if (!labReader.open())
+	{
+		return false;
+	}
+
+	// Entries the writer couldn't read are dropped, so they are retried next time.
+	std::vector<char> notPacked(manifest.getEntryCount(), 0);
+
+	for (std::size_t i = 0; i < manifest.getEntryCount(); ++i)
+	{
+		auto & entry = manifest.getEntry(i);
+		const std::size_t index = labReader.findEntry(entry.name);
+		if (index == ol::LabArchiveReader::EntryNotFound)
+		{
+			notPacked[i] = 1;
+			continue;
+		}
+
+		entry.dataOffset = labReader.getEntryDataOffset(index);
+		if (!checksumKnown[i])
+		{
+			// Checksum what was actually packed, straight from the page cache.
+			const auto mapping = labReader.mapEntry(index);
+			if (!mapping && entry.sizeInBytes != 0)
+			{
+				return false;
+			}
+			entry.checksum = mapping ? ol::crc32c(mapping.getData(), mapping.getSize()) : 0;
+		}
+	}
+
+	manifest.removeEntries(notPacked);
+	return manifest.setArchive(outputLab);
+}
+
+//
+// Compares the source tree with the manifest of the last incremental
+// build. Files with the same size and time, or the same checksum if only
+// the time changed, are unchanged. If they all are and the pack options
+// are the same, the archive is left alone. Otherwise unchanged entries are
+// copied from the old archive by range and only the rest is read from the
+// source files. The new archive is written next to the old one, then
+// replaces it.
+//
+static bool packIncremental(ol::LabArchiveWriter & labWriter, const std::string & inputDir,
+                            const std::string & outputLab, const ol::LabArchiveWriter::WriteMode writeMode,
+                            const int numThreads, const std::uint32_t orderChecksum, const bool verbose)
+{
+	const std::string manifestFile = ol::LabBuildManifest::getFileNameFor(outputLab);
+
+	ol::LabBuildManifest oldManifest;
+	const bool canReuse = oldManifest.load(manifestFile) && oldManifest.matchesArchive(outputLab);
+
+	// Entry data doesn't depend on the options, only the layout does.
+	const bool sameOptions = oldManifest.getDataAlignment() == labWriter.getDataAlignment() &&
+	                         oldManifest.isDeduplicated() == labWriter.isDeduplicating() &&
+	                         oldManifest.getDataOrderChecksum() == orderChecksum;
+
+	const auto fileList = ol::filesys::listFilesRecursive(inputDir);
+	if (fileList.empty())
+	{
+		std::cerr << "Warning: Could not find any files in path \'" << inputDir << "\'!\n";
+		return false;
+	}
+
+	ol::LabBuildManifest newManifest;
+	newManifest.setPackOptions(labWriter.getDataAlignment(), labWriter.isDeduplicating(), orderChecksum);
+
+	// Indexed like the new manifest entries, which skip repeated names.
+	std::vector<const ol::filesys::ListedFile *> sourceFiles;
+	std::vector<char> unchanged;
+	std::vector<char> checksumKnown;
+	sourceFiles.reserve(fileList.size());
+	unchanged.reserve(fileList.size());
+	checksumKnown.reserve(fileList.size());
+
+	bool upToDate = canReuse && sameOptions;
+	bool timesChanged = false;
+	std::size_t reusedCount = 0;
+
+	for (const auto & listedFile : fileList)
+	{
+		const std::size_t i = newManifest.getEntryCount();
+
+		ol::LabBuildManifest::Entry entry;
+		entry.name         = listedFile.path;
+		entry.sizeInBytes  = listedFile.sizeInBytes;
+		entry.modifiedTime = listedFile.modifiedTime;
+		entry.checksum     = 0;
+		entry.dataOffset   = 0;
+		std::replace(std::begin(entry.name), std::end(entry.name), '/', '\\');
+
+		bool isUnchanged = false;
+		bool isChecksumKnown = false;
+
+		const std::size_t oldIndex = canReuse ? oldManifest.findEntry(entry.name) : ol::LabBuildManifest::EntryNotFound;
+		if (oldIndex != ol::LabBuildManifest::EntryNotFound && oldManifest.getEntry(oldIndex).sizeInBytes == entry.sizeInBytes)
+		{
+			const auto & oldEntry = oldManifest.getEntry(oldIndex);
+			if (oldEntry.modifiedTime == entry.modifiedTime)
+			{
+				isUnchanged = true;
+			}
+			else if (ol::crc32cFile(inputDir + listedFile.path, entry.checksum))
+			{
+				// Touched or regenerated, but maybe with the same contents.
+				isChecksumKnown = true;
+				isUnchanged = (entry.checksum == oldEntry.checksum);
+			}
+
+			if (isUnchanged)
+			{
+				entry.checksum   = oldEntry.checksum;
+				entry.dataOffset = oldEntry.dataOffset;
+				isChecksumKnown  = true;
+			}
+		}
+
+		// Names that differ only in case would be the same LAB entry.
+		if (!newManifest.addEntry(entry))
+		{
+			std::cerr << "Entry \'" << entry.name << "\' was already added to the LAB archive!\n";
+			continue;
+		}
+
+		sourceFiles.push_back(&listedFile);
+		unchanged.push_back(isUnchanged);
+		checksumKnown.push_back(isChecksumKnown);
+
+		if (isUnchanged)
+		{
+			timesChanged = timesChanged || (oldManifest.getEntry(oldIndex).modifiedTime != entry.modifiedTime);
+			++reusedCount;
+		}
+		upToDate = upToDate && isUnchanged && (oldIndex == i);
+	}
+
+	upToDate = upToDate && (newManifest.getEntryCount() == oldManifest.getEntryCount());
+
+	if (upToDate)
+	{
+		// Same archive, only the source file times need updating.
+		if (timesChanged && (!newManifest.setArchive(outputLab) || !newManifest.save(manifestFile)))
+		{
+			return false;
+		}
+		if (verbose)
+		{
+			std::cout << "LAB archive is up to date, " << newManifest.getEntryCount() << " files unchanged.\n";
+		}
+		return true;
+	}
+
+	for (std::size_t i = 0; i < newManifest.getEntryCount(); ++i)
+	{
+		const auto & entry = newManifest.getEntry(i);
+		if (unchanged[i] && entry.sizeInBytes != 0)
+		{
+			labWriter.addFileRange(entry.name, outputLab, entry.dataOffset, static_cast<std::size_t>(entry.sizeInBytes));
+		}
+		else
+		{
+			labWriter.addFile(entry.name, inputDir + sourceFiles[i]->path);
+		}
+	}
+
+	// The old archive is read while the new one is written.
+	const std::string tempLab = outputLab + ".tmp";
+	{
+		ol::LabFileSink sink { tempLab };
+		if (!sink.open() || !labWriter.write(sink, writeMode, numThreads))
+		{
+			std::remove(tempLab.c_str());
+			return false;
+		}
+	}
+
+	if (!ol::filesys::replaceFile(tempLab, outputLab))
+	{
+		std::remove(tempLab.c_str());
+		return false;
+	}
+
+	if (verbose)
+	{
+		std::cout << "Reused " << reusedCount << " unchanged entries from the previous archive, repacked "
+		          << (newManifest.getEntryCount() - reusedCount) << ".\n";
+	}
+
+	// A stale manifest would describe the wrong archive, so it goes either way.
+	if (!updateManifest(newManifest, checksumKnown, outputLab) || !newManifest.save(manifestFile))
+	{
+		std::remove(manifestFile.c_str());
+		std::cerr << "Failed to update the manifest " << manifestFile << "!\n";
+	}
+	return true;
+}
+
 int main(int argc, const char * argv[])
 {
 	// At least the program name and source file/help-flag.
@@ -63,14 +299,65 @@ int main(int argc, const char * argv[])
 
 	const std::string outputLab = argv[2];
 	bool verbose = false;
+	auto writeMode = ol::LabArchiveWriter::WriteMode::InMemory;
+	int numThreads = 1;
+	bool dedup = false;
+	std::uint32_t alignment = 1;
+	bool incremental = false;
+	const char * orderFile = nullptr;
 
-	// Possible verbose flag, ignore if anything else.
-	if (argc >= 4)
+	// Optional flags, ignore anything else.
+	for (int i = 3; i < argc; ++i)
 	{
-		if (std::strcmp(argv[3], "-v") == 0 || std::strcmp(argv[3], "--verbose") == 0)
+		if (std::strcmp(argv[i], "-v") == 0 || std::strcmp(argv[i], "--verbose") == 0)
 		{
 			verbose = true;
 		}
+		else if (std::strcmp(argv[i], "-s") == 0 || std::strcmp(argv[i], "--stream") == 0)
+		{
+			writeMode = ol::LabArchiveWriter::WriteMode::Streaming;
+		}
+		else if (std::strcmp(argv[i], "-d") == 0 || std::strcmp(argv[i], "--dedup") == 0)
+		{
+			dedup = true;
+		}
+		else if (std::strcmp(argv[i], "-i") == 0 || std::strcmp(argv[i], "--incremental") == 0)
+		{
+			incremental = true;
+		}
+		else if (std::strcmp(argv[i], "-o") == 0 || std::strcmp(argv[i], "--order") == 0)
+		{
+			orderFile = getFlagValue(argc, argv, i);
+			if (orderFile == nullptr) { return EXIT_FAILURE; }
+		}
+		else if (std::strcmp(argv[i], "-a") == 0 || std::strcmp(argv[i], "--align") == 0)
+		{
+			const char * value = getFlagValue(argc, argv, i);
+			if (value == nullptr) { return EXIT_FAILURE; }
+
+			char * valueEnd = nullptr;
+			const long bytes = std::strtol(value, &valueEnd, 10);
+			if (valueEnd == value || *valueEnd != '\0' || bytes <= 0 || bytes > (1 << 24))
+			{
+				std::cerr << "Invalid alignment " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			alignment = static_cast<std::uint32_t>(bytes);
+		}
+		else if (std::strcmp(argv[i], "-j") == 0 || std::strcmp(argv[i], "--jobs") == 0)
+		{
+			const char * value = getFlagValue(argc, argv, i);
+			if (value == nullptr) { return EXIT_FAILURE; }
+
+			char * valueEnd = nullptr;
+			const long jobs = std::strtol(value, &valueEnd, 10);
+			if (valueEnd == value || *valueEnd != '\0' || jobs < 0 || jobs > 4096)
+			{
+				std::cerr << "Invalid number of jobs " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			numThreads = static_cast<int>(jobs);
+		}
 	}
 
 	if (verbose)
@@ -80,15 +367,51 @@ int main(int argc, const char * argv[])
 		std::cout << "Preparing to write LAB archive...\n";
 	}
 
-	ol::LabArchiveWriter labWriter { outputLab, inputDir };
-	if (!labWriter.write())
+	ol::LabArchiveWriter labWriter;
+	labWriter.setDeduplication(dedup);
+	labWriter.setDataAlignment(alignment);
+
+	// An incremental build must redo the layout when the ordering changes.
+	std::uint32_t orderChecksum = 0;
+	if (orderFile != nullptr && (!labWriter.loadDataOrder(orderFile) || !ol::crc32cFile(orderFile, orderChecksum)))
+	{
+		return EXIT_FAILURE;
+	}
+
+	bool packed = false;
+	if (incremental)
+	{
+		packed = packIncremental(labWriter, inputDir, outputLab, writeMode, numThreads, orderChecksum, verbose);
+	}
+	else
+	{
+		ol::LabFileSink sink { outputLab };
+		labWriter.addDirectory(inputDir);
+		packed = (labWriter.getEntryCount() != 0) && sink.open() && labWriter.write(sink, writeMode, numThreads);
+	}
+
+	if (!packed)
 	{
 		std::cerr << "Failed to write specified LAB archive!\n";
 		return EXIT_FAILURE;
 	}
 
-	if (verbose)
+	// Nothing was added to the writer if the archive was up to date.
+	if (verbose && labWriter.getEntryCount() != 0)
 	{
+		if (dedup)
+		{
+			std::cout << "Deduplicated " << labWriter.getDuplicateCount() << " files, saving "
+			          << labWriter.getBytesSavedByDedup() << " bytes.\n";
+		}
+		if (alignment > 1)
+		{
+			std::size_t archiveSize = 0;
+			ol::filesys::queryFileSize(outputLab, archiveSize);
+			std::cout << "Alignment padding: " << labWriter.getPaddingBytes() << " bytes ("
+			          << (archiveSize != 0 ? 100.0 * labWriter.getPaddingBytes() / archiveSize : 0.0)
+			          << "% of the archive).\n";
+		}
 		std::cout << "LAB archive successfully created!\n";
 	}
 	return EXIT_SUCCESS;
@@ -13,16 +13,29 @@
 #include <string>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 
 static void printHelpText(const char * progName)
 {
 	std::cout
 		<< "\n"
 		<< "Usage:\n"
-		<< "$ " << progName << " <input_lab> <output_dir> [--verbose | -v]\n"
+		<< "$ " << progName << " <input_lab> <output_dir> [--verbose | -v] [--mmap | -m] [--jobs | -j <N>]\n"
+		<< "     [--name | -n <pattern>] [--ext | -e <extension>] [--type | -t <4CC>]\n"
 		<< "  Unpacks each file in the given LAB archive to the provided path.\n"
 		<< "  Creates directories as needed. Existing files are overwritten.\n"
 		<< "  If the --verbose|-v flag is provided, prints a list of files and other running stats to STDOUT.\n"
+		<< "  If the --mmap|-m flag is provided, the archive is memory mapped instead of loaded into memory.\n"
+		<< "  If the --jobs|-j flag is provided, files are extracted by N threads (0 = one per CPU core).\n"
+		<< "  The --name|-n, --ext|-e and --type|-t flags restrict extraction to matching entries.\n"
+		<< "  Each can be repeated; an entry is extracted if it matches one value of every flag given.\n"
+		<< "  Patterns accept the '*' and '?' wildcards. Example: -t MTXT -t PXCP -n \"hideout*\"\n"
+		<< "  If <input_lab> is '-', the archive is read from STDIN in a single pass.\n"
+		<< "\n"
+		<< "Usage:\n"
+		<< "$ " << progName << " <input_lab> --list | -l\n"
+		<< "  Prints the list of entries in the given LAB archive without extracting them.\n"
+		<< "  Only the archive header and entry table are read.\n"
 		<< "\n"
 		<< "Usage:\n"
 		<< "$ " << progName << " --help | -h\n"
@@ -30,6 +43,17 @@ static void printHelpText(const char * progName)
 		<< "\n";
 }
 
+// Value following the flag at argv[i], advancing i. Null if missing.
+static const char * getFlagValue(const int argc, const char * argv[], int & i)
+{
+	if (i + 1 >= argc)
+	{
+		std::cerr << "Missing value after " << argv[i] << "!\n";
+		return nullptr;
+	}
+	return argv[++i];
+}
+
 int main(int argc, const char * argv[])
 {
 	// At least the program name and source file/help-flag.
@@ -47,7 +71,7 @@ int main(int argc, const char * argv[])
 		return EXIT_SUCCESS;
 	}
 
-	// From here on we need an input filename and an output path.
+	// From here on we need an input filename and an output path or --list.
 	if (argc < 3)
 	{
 		std::cerr << "Not enough arguments!\n";
@@ -55,7 +79,23 @@ int main(int argc, const char * argv[])
 		return EXIT_FAILURE;
 	}
 
+	// Listing only needs the entry table, so don't bother loading the rest.
+	if (std::strcmp(argv[2], "-l") == 0 || std::strcmp(argv[2], "--list") == 0)
+	{
+		ol::LabArchiveReader labReader { argv[1], ol::LabArchiveReader::OpenMode::MetadataOnly };
+		if (!labReader.open())
+		{
+			std::cerr << "Unable to open the specified LAB archive!\n";
+			return EXIT_FAILURE;
+		}
+		labReader.listFileEntries(std::cout);
+		return EXIT_SUCCESS;
+	}
+
 	bool verbose = false;
+	bool useMmap = false;
+	int numThreads = 1;
+	ol::LabArchiveReader::EntryFilter filter;
 	const std::string labFileName = argv[1];
 
 	// Make sure the path ends with a '/' or backslash.
@@ -65,13 +105,66 @@ int main(int argc, const char * argv[])
 		outputDir += ol::filesys::getPathSeparator();
 	}
 
-	// Possible verbose flag, ignore if anything else.
-	if (argc >= 4)
+	// Optional flags, ignore anything else.
+	for (int i = 3; i < argc; ++i)
 	{
-		if (std::strcmp(argv[3], "-v") == 0 || std::strcmp(argv[3], "--verbose") == 0)
+		if (std::strcmp(argv[i], "-v") == 0 || std::strcmp(argv[i], "--verbose") == 0)
 		{
 			verbose = true;
 		}
+		else if (std::strcmp(argv[i], "-m") == 0 || std::strcmp(argv[i], "--mmap") == 0)
+		{
+			useMmap = true;
+		}
+		else if (std::strcmp(argv[i], "-j") == 0 || std::strcmp(argv[i], "--jobs") == 0)
+		{
+			const char * value = getFlagValue(argc, argv, i);
+			if (value == nullptr) { return EXIT_FAILURE; }
+
+			char * valueEnd = nullptr;
+			const long jobs = std::strtol(value, &valueEnd, 10);
+			if (valueEnd == value || *valueEnd != '\0' || jobs < 0 || jobs > 4096)
+			{
+				std::cerr << "Invalid number of jobs " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			numThreads = static_cast<int>(jobs);
+		}
+		else if (std::strcmp(argv[i], "-n") == 0 || std::strcmp(argv[i], "--name") == 0)
+		{
+			const char * value = getFlagValue(argc, argv, i);
+			if (value == nullptr) { return EXIT_FAILURE; }
+			filter.namePatterns.emplace_back(value);
+		}
+		else if (std::strcmp(argv[i], "-e") == 0 || std::strcmp(argv[i], "--ext") == 0)
+		{
+			const char * value = getFlagValue(argc, argv, i);
+			if (value == nullptr) { return EXIT_FAILURE; }
+			filter.extensions.emplace_back(value);
+		}
+		else if (std::strcmp(argv[i], "-t") == 0 || std::strcmp(argv[i], "--type") == 0)
+		{
+			const char * value = getFlagValue(argc, argv, i);
+			if (value == nullptr) { return EXIT_FAILURE; }
+			if (std::strlen(value) != 4)
+			{
+				std::cerr << "Type id must have exactly 4 characters: " << value << "\n";
+				return EXIT_FAILURE;
+			}
+			filter.typeIds.emplace_back(value);
+		}
+	}
+
+	// When only some entries are wanted, don't load the whole archive,
+	// just read the entry table and then the bytes of each selected entry.
+	auto openMode = ol::LabArchiveReader::OpenMode::LoadWholeFile;
+	if (useMmap)
+	{
+		openMode = ol::LabArchiveReader::OpenMode::MemoryMapped;
+	}
+	else if (!filter.empty())
+	{
+		openMode = ol::LabArchiveReader::OpenMode::MetadataOnly;
 	}
 
 	if (verbose)
@@ -80,7 +173,22 @@ int main(int argc, const char * argv[])
 		std::cout << "Output path: \"" << outputDir   << "\"\n";
 	}
 
-	ol::LabArchiveReader labReader { labFileName };
+	// Streamed input can't be seeked, so it gets the single-pass unpacker.
+	if (labFileName == "-")
+	{
+		if (verbose) { std::cout << "Extracting files from STDIN...\n"; }
+		ol::filesys::setBinaryMode(stdin);
+		const int filesWritten = ol::LabArchiveReader::extractFromStream(stdin, "<stdin>", outputDir, filter);
+		if (filesWritten < 0)
+		{
+			std::cerr << "Unable to unpack the LAB archive from STDIN!\n";
+			return EXIT_FAILURE;
+		}
+		if (verbose) { std::cout << "Done! Extracted " << filesWritten << " files.\n"; }
+		return EXIT_SUCCESS;
+	}
+
+	ol::LabArchiveReader labReader { labFileName, openMode };
 	if (!labReader.open())
 	{
 		std::cerr << "Unable to open the specified LAB archive!\n";
@@ -95,8 +203,10 @@ int main(int argc, const char * argv[])
 
 	// Extract:
 	if (verbose) { std::cout << "Extracting files...\n"; }
-	labReader.extractWholeArchive(outputDir);
-	if (verbose) { std::cout << "Done!\n"; }
+	const int filesWritten = filter.empty() ?
+		labReader.extractWholeArchive(outputDir, numThreads) :
+		labReader.extractEntries(outputDir, filter, numThreads);
+	if (verbose) { std::cout << "Done! Extracted " << filesWritten << " files.\n"; }
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,380 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_verify.cpp
+// Created on: 16/10/26
+// Brief: Command line tool to checksum LucasArts LAB archives and verify them against a manifest.
+// ================================================================================================
+
+#include "ol/crc32c.hpp"
+#include "ol/filesys_utils.hpp"
+#include "ol/lab_archive_reader.hpp"
+#include "ol/lab_common.hpp"
+#include "ol/lab_name_index.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+struct ManifestEntry
+{
+	std::uint32_t crc;
+	std::size_t   sizeInBytes;
+	std::string   name;
+};
+
+static void printHelpText(const char * progName)
+{
+	std::cout
+		<< "\n"
+		<< "Usage:\n"
+		<< "$ " << progName << " <input_lab> [--emit | -e <manifest>] [--jobs | -j <N>] [--verbose | -v]\n"
+		<< "  Computes the CRC-32C checksum of each entry in the LAB archive and writes a manifest\n"
+		<< "  to the given file, or to STDOUT if --emit|-e is not provided. Fails if any entry of the\n"
+		<< "  archive table is corrupted, rather than leaving it out of the manifest.\n"
+		<< "\n"
+		<< "Usage:\n"
+		<< "$ " << progName << " <input_lab_or_dir> --check | -c <manifest> [--jobs | -j <N>] [--verbose | -v]\n"
+		<< "  Checks a LAB archive, or a directory it was unpacked to, against a manifest.\n"
+		<< "  Mismatching, missing and extra entries are printed. Exit status is non-zero if any.\n"
+		<< "\n"
+		<< "  --jobs|-j sets the number of checksumming threads (default 0 = one per CPU core).\n"
+		<< "  --verbose|-v prints throughput stats to STDOUT,\n"
+		<< "  or to STDERR if the manifest goes to STDOUT.\n"
+		<< "\n"
+		<< "Usage:\n"
+		<< "$ " << progName << " --help | -h\n"
+		<< "  Prints this help text.\n"
+		<< "\n";
+}
+
+// Value following the flag at argv[i], advancing i. Null if missing.
+static const char * getFlagValue(const int argc, const char * argv[], int & i)
+{
+	if (i + 1 >= argc)
+	{
+		std::cerr << "Missing value after " << argv[i] << "!\n";
+		return nullptr;
+	}
+	return argv[++i];
+}
+
+// Manifest lines are "<crc32c hex> <size> <name>". Lines starting with '#' are comments.
+static bool writeManifest(std::ostream & os, const std::string & labFileName, const std::vector<ManifestEntry> & entries)
+{
+	os << "# LAB manifest for \'" << labFileName << "\'\n";
+	os << "# crc32c size name\n";
+	for (const auto & entry : entries)
+	{
+		os << std::hex << std::setw(8) << std::setfill('0') << entry.crc << std::dec
+		   << " " << entry.sizeInBytes << " " << entry.name << "\n";
+	}
+	return os.good();
+}
+
+static bool readManifest(const std::string & manifestFile, std::vector<ManifestEntry> & entries)
+{
+	std::ifstream manifest{ manifestFile };
+	if (!manifest)
+	{
+		std::cerr << "Can't open manifest file " << manifestFile << "!\n";
+		return false;
+	}
+
+	std::string line;
+	int lineNum = 0;
+	while (std::getline(manifest, line))
+	{
+		++lineNum;
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		char * sizeStr = nullptr;
+		char * nameStr = nullptr;
+		const auto crc  = std::strtoul(line.c_str(), &sizeStr, 16);
+		const auto size = std::strtoull(sizeStr, &nameStr, 10);
+
+		if (sizeStr == line.c_str() || nameStr == sizeStr || *nameStr != ' ')
+		{
+			std::cerr << "Bad manifest line " << lineNum << " in " << manifestFile << "!\n";
+			return false;
+		}
+
+		entries.push_back({ static_cast<std::uint32_t>(crc), static_cast<std::size_t>(size), nameStr + 1 });
+	}
+	return true;
+}
+
+// Also fails if any entry of the table was corrupted, since the
+// checksums would then cover less than the whole archive.
+static bool checksumArchive(const std::string & labFileName, const int numThreads, std::vector<ManifestEntry> & entries)
+{
+	// Mapped, so checksumming reads straight from the page cache.
+	ol::LabArchiveReader labReader { labFileName, ol::LabArchiveReader::OpenMode::MemoryMapped };
+	if (!labReader.open())
+	{
+		std::cerr << "Unable to open the specified LAB archive!\n";
+		return false;
+	}
+	if (labReader.getRejectedEntryCount() != 0)
+	{
+		std::cerr << labReader.getRejectedEntryCount() << " corrupted entries in the LAB archive table!\n";
+		return false;
+	}
+
+	std::vector<std::uint32_t> checksums;
+	if (!labReader.computeEntryChecksums(checksums, numThreads))
+	{
+		return false;
+	}
+
+	entries.reserve(labReader.getEntryCount());
+	for (std::size_t i = 0; i < labReader.getEntryCount(); ++i)
+	{
+		entries.push_back({ checksums[i], labReader.getEntrySize(i), labReader.getEntryName(i) });
+	}
+	return true;
+}
+
+static int checkDirectory(const std::string & dirPath, const int numThreads, const std::vector<ManifestEntry> & expected)
+{
+	std::atomic<int> failures{ 0 };
+	std::mutex logMutex;
+
+	ol::parallelFor(expected.size(), numThreads, [&](const std::size_t i)
+	{
+		std::string fileName = dirPath + ol::filesys::getPathSeparator() + expected[i].name;
+		std::replace(std::begin(fileName), std::end(fileName), '\\', '/');
+
+		std::uint32_t crc = 0;
+		std::size_t size  = 0;
+		const char * problem = nullptr;
+
+		if (!ol::crc32cFile(fileName, crc, &size))
+		{
+			problem = "MISSING";
+		}
+		else if (crc != expected[i].crc || size != expected[i].sizeInBytes)
+		{
+			problem = "MISMATCH";
+		}
+
+		if (problem != nullptr)
+		{
+			std::lock_guard<std::mutex> lock{ logMutex };
+			std::cout << problem << " " << expected[i].name << "\n";
+			++failures;
+		}
+	});
+
+	// Files the manifest doesn't list. Matched like LAB entry names, ignoring case.
+	ol::LabNameIndex expectedIndex;
+	expectedIndex.reset(expected.size());
+	for (std::size_t i = 0; i < expected.size(); ++i)
+	{
+		expectedIndex.insert(expected[i].name.data(), expected[i].name.length(), static_cast<std::uint32_t>(i));
+	}
+
+	for (const auto & listedFile : ol::filesys::listFilesRecursive(dirPath, numThreads, true))
+	{
+		if (expectedIndex.find(listedFile.path) == ol::LabNameIndex::NotFound)
+		{
+			std::string name = listedFile.path;
+			std::replace(std::begin(name), std::end(name), '/', '\\');
+			std::cout << "EXTRA " << name << "\n";
+			++failures;
+		}
+	}
+
+	return failures;
+}
+
+static int checkEntries(const std::vector<ManifestEntry> & actual, const std::vector<ManifestEntry> & expected)
+{
+	ol::LabNameIndex actualIndex;
+	actualIndex.reset(actual.size());
+	for (std::size_t i = 0; i < actual.size(); ++i)
+	{
+		actualIndex.insert(actual[i].name.data(), actual[i].name.length(), static_cast<std::uint32_t>(i));
+	}
+
+	int failures = 0;
+	std::vector<bool> seen(actual.size(), false);
+
+	for (const auto & entry : expected)
+	{
+		const auto index = actualIndex.find(entry.name);
+		if (index == ol::LabNameIndex::NotFound)
+		{
+			std::cout << "MISSING " << entry.name << "\n";
+			++failures;
+			continue;
+		}
+
+		seen[index] = true;
+		if (actual[index].crc != entry.crc || actual[index].sizeInBytes != entry.sizeInBytes)
+		{
+			std::cout << "MISMATCH " << entry.name << "\n";
+			++failures;
+		}
+	}
+
+	for (std::size_t i = 0; i < actual.size(); ++i)
+	{
+		if (!seen[i])
+		{
+			std::cout << "EXTRA " << actual[i].name << "\n";
+			++failures;
+		}
+	}
+
+	return failures;
+}
+
+int main(int argc, const char * argv[])
+{
+	// At least the program name and source file/help-flag.
+	if (argc < 2)
+	{
+		std::cerr << "Not enough arguments!\n";
+		printHelpText(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Printing help is not treated as an error.
+	if (std::strcmp(argv[1], "-h") == 0 || std::strcmp(argv[1], "--help") == 0)
+	{
+		printHelpText(argv[0]);
+		return EXIT_SUCCESS;
+	}
+
+	const std::string inputPath = argv[1];
+	std::string emitFile;
+	std::string checkFile;
+	int numThreads = 0;
+	bool verbose = false;
+
+	// Optional flags, ignore anything else.
+	for (int i = 2; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "-v") == 0 || std::strcmp(argv[i], "--verbose") == 0)
+		{
+			verbose = true;
+		}
+		else if (std::strcmp(argv[i], "-j") == 0 || std::strcmp(argv[i], "--jobs") == 0)
+		{
+			const char * value = getFlagValue(argc, argv, i);
+			if (value == nullptr) { return EXIT_FAILURE; }
+
+			char * valueEnd = nullptr;
+			const long jobs = std::strtol(value, &valueEnd, 10);
+			if (valueEnd == value || *valueEnd != '\0' || jobs < 0 || jobs > 4096)
+			{
+				std::cerr << "Invalid number of jobs " << value << "!\n";
+				return EXIT_FAILURE;
+			}
+			numThreads = static_cast<int>(jobs);
+		}
+		else if (std::strcmp(argv[i], "-e") == 0 || std::strcmp(argv[i], "--emit") == 0)
+		{
+			const char * value = getFlagValue(argc, argv, i);
+			if (value == nullptr) { return EXIT_FAILURE; }
+			emitFile = value;
+		}
+		else if (std::strcmp(argv[i], "-c") == 0 || std::strcmp(argv[i], "--check") == 0)
+		{
+			const char * value = getFlagValue(argc, argv, i);
+			if (value == nullptr) { return EXIT_FAILURE; }
+			checkFile = value;
+		}
+	}
+
+	const auto startTime = std::chrono::steady_clock::now();
+	std::vector<ManifestEntry> expected;
+	std::vector<ManifestEntry> actual;
+	int failures = 0;
+
+	if (!checkFile.empty())
+	{
+		if (!readManifest(checkFile, expected))
+		{
+			return EXIT_FAILURE;
+		}
+
+		// Anything that isn't a regular file is assumed to be an unpacked directory.
+		std::size_t labSize = 0;
+		if (ol::filesys::queryFileSize(inputPath, labSize))
+		{
+			if (!checksumArchive(inputPath, numThreads, actual))
+			{
+				return EXIT_FAILURE;
+			}
+			failures = checkEntries(actual, expected);
+		}
+		else
+		{
+			failures = checkDirectory(inputPath, numThreads, expected);
+		}
+	}
+	else
+	{
+		if (!checksumArchive(inputPath, numThreads, actual))
+		{
+			return EXIT_FAILURE;
+		}
+
+		if (emitFile.empty())
+		{
+			writeManifest(std::cout, inputPath, actual);
+		}
+		else
+		{
+			std::ofstream manifest{ emitFile };
+			if (!manifest || !writeManifest(manifest, inputPath, actual))
+			{
+				std::cerr << "Failed to write manifest file " << emitFile << "!\n";
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	if (verbose)
+	{
+		const auto & entries = checkFile.empty() ? actual : expected;
+		std::size_t totalBytes = 0;
+		for (const auto & entry : entries)
+		{
+			totalBytes += entry.sizeInBytes;
+		}
+
+		// Stats go to STDERR if the manifest goes to STDOUT.
+		std::ostream & out = (checkFile.empty() && emitFile.empty()) ? std::cerr : std::cout;
+
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		out << "Checksummed " << entries.size() << " entries, " << totalBytes << " bytes in "
+		    << seconds << "s (" << (totalBytes / (1024.0 * 1024.0) / (seconds > 0.0 ? seconds : 1.0))
+		    << " MB/s, hardware CRC: " << (ol::crc32cIsHardwareAccelerated() ? "yes" : "no") << ").\n";
+	}
+
+	if (!checkFile.empty())
+	{
+		if (failures != 0)
+		{
+			std::cout << failures << " problems found!\n";
+			return EXIT_FAILURE;
+		}
+		std::cout << "OK: " << expected.size() << " entries verified.\n";
+	}
+
+	return EXIT_SUCCESS;
+}
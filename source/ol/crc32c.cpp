@@ -0,0 +1,236 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: crc32c.cpp
+// Created on: 16/10/26
+// Brief: CRC-32C (Castagnoli) checksums, hardware accelerated where the CPU supports it.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#include "crc32c.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+	#define OL_CRC32C_SSE42 1
+	#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+	#define OL_CRC32C_ARMV8 1
+	#include <arm_acle.h>
+#endif
+
+namespace ol
+{
+
+// ========================================================
+// Portable slice-by-8 implementation:
+// ========================================================
+
+struct Crc32cTables
+{
+	std::uint32_t table[8][256];
+
+	Crc32cTables()
+	{
+		// Reflected Castagnoli polynomial.
+		const std::uint32_t poly = 0x82F63B78;
+		for (std::uint32_t i = 0; i < 256; ++i)
+		{
+			std::uint32_t crc = i;
+			for (int bit = 0; bit < 8; ++bit)
+			{
+				crc = (crc & 1) ? ((crc >> 1) ^ poly) : (crc >> 1);
+			}
+			table[0][i] = crc;
+		}
+		for (std::uint32_t i = 0; i < 256; ++i)
+		{
+			for (int t = 1; t < 8; ++t)
+			{
+				table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xFF];
+			}
+		}
+	}
+};
+
+static std::uint32_t crc32cSoftware(const std::uint8_t * bytes, std::size_t sizeInBytes, std::uint32_t crc)
+{
+	static const Crc32cTables tables;
+	const auto & t = tables.table;
+
+	#if !defined(__BYTE_ORDER__) || (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	// Eight bytes per step. The word loads assume a little-endian CPU.
+	while (sizeInBytes >= 8)
+	{
+		std::uint32_t lo, hi;
+		std::memcpy(&lo, bytes,     4);
+		std::memcpy(&hi, bytes + 4, 4);
+		lo ^= crc;
+		crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+		      t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+		bytes       += 8;
+		sizeInBytes -= 8;
+	}
+	#endif
+
+	while (sizeInBytes > 0)
+	{
+		crc = t[0][(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+		--sizeInBytes;
+	}
+	return crc;
+}
+
+// ========================================================
+// Hardware implementations:
+// ========================================================
+
+#if OL_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static std::uint32_t crc32cHardware(const std::uint8_t * bytes, std::size_t sizeInBytes, std::uint32_t crc)
+{
+	#if defined(__x86_64__)
+	std::uint64_t crc64 = crc;
+	while (sizeInBytes >= 8)
+	{
+		std::uint64_t word;
+		std::memcpy(&word, bytes, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+		bytes       += 8;
+		sizeInBytes -= 8;
+	}
+	crc = static_cast<std::uint32_t>(crc64);
+	#endif
+
+	while (sizeInBytes >= 4)
+	{
+		std::uint32_t word;
+		std::memcpy(&word, bytes, 4);
+		crc = _mm_crc32_u32(crc, word);
+		bytes       += 4;
+		sizeInBytes -= 4;
+	}
+	while (sizeInBytes > 0)
+	{
+		crc = _mm_crc32_u8(crc, *bytes++);
+		--sizeInBytes;
+	}
+	return crc;
+}
+
+static bool cpuHasCrc32cInstructions()
+{
+	return __builtin_cpu_supports("sse4.2");
+}
+#elif OL_CRC32C_ARMV8
+static std::uint32_t crc32cHardware(const std::uint8_t * bytes, std::size_t sizeInBytes, std::uint32_t crc)
+{
+	while (sizeInBytes >= 8)
+	{
+		std::uint64_t word;
+		std::memcpy(&word, bytes, 8);
+		crc = __crc32cd(crc, word);
+		bytes       += 8;
+		sizeInBytes -= 8;
+	}
+	while (sizeInBytes > 0)
+	{
+		crc = __crc32cb(crc, *bytes++);
+		--sizeInBytes;
+	}
+	return crc;
+}
+
+static bool cpuHasCrc32cInstructions()
+{
+	return true; // Enabled at compile time.
+}
+#else
+static std::uint32_t crc32cHardware(const std::uint8_t * bytes, std::size_t sizeInBytes, std::uint32_t crc)
+{
+	return crc32cSoftware(bytes, sizeInBytes, crc);
+}
+
+static bool cpuHasCrc32cInstructions()
+{
+	return false;
+}
+#endif
+
+// ========================================================
+// crc32c():
+// ========================================================
+
+std::uint32_t crc32c(const void * data, const std::size_t sizeInBytes, const std::uint32_t crc)
+{
+	static const bool useHardware = cpuHasCrc32cInstructions();
+
+	const auto * bytes = static_cast<const std::uint8_t *>(data);
+	const std::uint32_t state = ~crc;
+
+	return ~(useHardware ? crc32cHardware(bytes, sizeInBytes, state) :
+	                       crc32cSoftware(bytes, sizeInBytes, state));
+}
+
+// ========================================================
+// crc32cFile():
+// ========================================================
+
+bool crc32cFile(const std::string & filename, std::uint32_t & crc, std::size_t * sizeInBytes)
+{
+	crc = 0;
+	if (sizeInBytes != nullptr) { *sizeInBytes = 0; }
+
+	FILE * fileIn = std::fopen(filename.c_str(), "rb");
+	if (fileIn == nullptr)
+	{
+		return false;
+	}
+
+	const std::size_t bufferSize = 256 * 1024;
+	auto buffer = std::make_unique<std::uint8_t[]>(bufferSize);
+	std::size_t totalBytes = 0;
+
+	for (;;)
+	{
+		const std::size_t bytesRead = std::fread(buffer.get(), sizeof(std::uint8_t), bufferSize, fileIn);
+		crc = crc32c(buffer.get(), bytesRead, crc);
+		totalBytes += bytesRead;
+
+		if (bytesRead < bufferSize)
+		{
+			break;
+		}
+	}
+
+	const bool readError = (std::ferror(fileIn) != 0);
+	std::fclose(fileIn);
+
+	if (readError)
+	{
+		crc = 0;
+		return false;
+	}
+
+	if (sizeInBytes != nullptr)
+	{
+		*sizeInBytes = totalBytes;
+	}
+	return true;
+}
+
+// ========================================================
+// crc32cIsHardwareAccelerated():
+// ========================================================
+
+bool crc32cIsHardwareAccelerated()
+{
+	return cpuHasCrc32cInstructions();
+}
+
+} // namespace ol {}
@@ -0,0 +1,36 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: crc32c.hpp
+// Created on: 16/10/26
+// Brief: CRC-32C (Castagnoli) checksums, hardware accelerated where the CPU supports it.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#ifndef OL_CRC32C_HPP
+#define OL_CRC32C_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace ol
+{
+
+// CRC-32C of a block of memory. To checksum data in pieces, pass the result
+// of the previous piece as crc; start with zero. Uses the SSE 4.2 or ARMv8
+// CRC instructions when available, a slice-by-8 table otherwise.
+std::uint32_t crc32c(const void * data, std::size_t sizeInBytes, std::uint32_t crc = 0);
+
+// CRC-32C of a whole file, read in fixed-size chunks. Optionally also returns
+// the file size. Returns false if the file can't be opened or read.
+bool crc32cFile(const std::string & filename, std::uint32_t & crc, std::size_t * sizeInBytes = nullptr);
+
+// Test if crc32c() runs on dedicated CPU instructions on this machine.
+bool crc32cIsHardwareAccelerated();
+
+} // namespace ol {}
+
+#endif // OL_CRC32C_HPP
@@ -24,10 +24,25 @@
 #include <sys/stat.h>
 #if defined(_WIN32)
 #include <direct.h>
+#include <fcntl.h>
+#include <io.h>
 #else
 #include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #endif
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
 namespace ol
 {
 namespace filesys
@@ -98,6 +113,51 @@ bool queryFileSize(const std::string & filename, std::size_t & sizeInBytes)
 }
 #endif
 
+// ========================================================
+// queryFileModifiedTime():
+// ========================================================
+
+#if defined(_WIN32)
+bool queryFileModifiedTime(const std::string & filename, std::int64_t & modifiedTime)
+{
+    assert(!filename.empty());
+
+    WIN32_FILE_ATTRIBUTE_DATA fileAttr;
+    if (GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &fileAttr) &&
+        !(fileAttr.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        // FILETIME counts 100ns intervals since 1601.
+        const std::uint64_t fileTime = (std::uint64_t(fileAttr.ftLastWriteTime.dwHighDateTime) << 32) |
+                                       fileAttr.ftLastWriteTime.dwLowDateTime;
+        modifiedTime = (std::int64_t(fileTime) - 116444736000000000LL) * 100;
+        return true;
+    }
+
+    modifiedTime = 0;
+    return false;
+}
+#else
+bool queryFileModifiedTime(const std::string & filename, std::int64_t & modifiedTime)
+{
+	assert(!filename.empty());
+
+	struct stat statBuf = {};
+	if (stat(filename.c_str(), &statBuf) == 0 && S_ISREG(statBuf.st_mode))
+	{
+		#if defined(__APPLE__)
+		const auto & modTime = statBuf.st_mtimespec;
+		#else
+		const auto & modTime = statBuf.st_mtim;
+		#endif
+		modifiedTime = std::int64_t(modTime.tv_sec) * 1000000000LL + modTime.tv_nsec;
+		return true;
+	}
+
+	modifiedTime = 0;
+	return false;
+}
+#endif
+
 // ========================================================
 // createDirectory():
 // ========================================================
@@ -150,33 +210,186 @@ bool createDirectory(const std::string & dirPath)
 
 bool createPath(const std::string & pathEndedWithSeparatorOrFilename)
 {
-	char dirPath[1024];
-
 	assert(!pathEndedWithSeparatorOrFilename.empty());
-	assert(pathEndedWithSeparatorOrFilename.length() < sizeof(dirPath) && "Pathname too long!");
 
-	std::strncpy(dirPath, pathEndedWithSeparatorOrFilename.c_str(), sizeof(dirPath) - 1);
-	dirPath[sizeof(dirPath) - 1] = '\0';
+	std::string dirPath;
+	dirPath.reserve(pathEndedWithSeparatorOrFilename.length());
 
-	char * pPath = dirPath;
-	while (*pPath != '\0')
+	for (const char c : pathEndedWithSeparatorOrFilename)
 	{
 		// Works for both Win and Unix without the need for extra tweaks.
-		if (*pPath == '/' || *pPath == '\\')
+		// Empty prefix is the root of an absolute path, which always exists.
+		if ((c == '/' || c == '\\') && !dirPath.empty())
 		{
-			*pPath = '\0';
 			if (!createDirectory(dirPath))
 			{
 				return false;
 			}
-			*pPath = *getPathSeparator();
 		}
-		++pPath;
+		dirPath += (c == '\\') ? *getPathSeparator() : c;
+	}
+
+	return true;
+}
+
+// ========================================================
+// removeDirectory():
+// ========================================================
+
+#if defined(_WIN32)
+bool removeDirectory(const std::string & dirPath)
+{
+    assert(!dirPath.empty());
+    return _rmdir(dirPath.c_str()) == 0;
+}
+#else
+bool removeDirectory(const std::string & dirPath)
+{
+	assert(!dirPath.empty());
+	return rmdir(dirPath.c_str()) == 0;
+}
+#endif
+
+// ========================================================
+// replaceFile():
+// ========================================================
+
+#if defined(_WIN32)
+bool replaceFile(const std::string & srcFile, const std::string & destFile)
+{
+    assert(!srcFile.empty());
+    assert(!destFile.empty());
+    return MoveFileExA(srcFile.c_str(), destFile.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+#else
+bool replaceFile(const std::string & srcFile, const std::string & destFile)
+{
+	assert(!srcFile.empty());
+	assert(!destFile.empty());
+	return std::rename(srcFile.c_str(), destFile.c_str()) == 0;
+}
+#endif
+
+// ========================================================
+// openDirectory() / closeDirectory():
+// ========================================================
+
+#if defined(_WIN32)
+bool openDirectory(const std::string & dirPath, DirectoryHandle & dirHandle)
+{
+    assert(!dirPath.empty());
+
+    const DWORD fileAttr = GetFileAttributesA(dirPath.c_str());
+    if (fileAttr == INVALID_FILE_ATTRIBUTES || !(fileAttr & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        std::cerr << "Can't open directory \'" << dirPath << "\'!\n";
+        return false;
+    }
+
+    dirHandle.path = dirPath;
+    if (dirHandle.path.back() != '/' && dirHandle.path.back() != '\\')
+    {
+        dirHandle.path += getPathSeparator();
+    }
+    return true;
+}
+
+void closeDirectory(DirectoryHandle & dirHandle)
+{
+    dirHandle.path.clear();
+}
+#else
+bool openDirectory(const std::string & dirPath, DirectoryHandle & dirHandle)
+{
+	assert(!dirPath.empty());
+
+	errno = 0;
+	dirHandle.fd = open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirHandle.fd < 0)
+	{
+		std::cerr << "open() failed for directory \'" << dirPath << "\': " << std::strerror(errno) << ".\n";
+		return false;
 	}
 
+	dirHandle.path = dirPath;
+	if (dirHandle.path.back() != '/')
+	{
+		dirHandle.path += getPathSeparator();
+	}
 	return true;
 }
 
+void closeDirectory(DirectoryHandle & dirHandle)
+{
+	if (dirHandle.fd >= 0)
+	{
+		::close(dirHandle.fd);
+		dirHandle.fd = -1;
+	}
+	dirHandle.path.clear();
+}
+#endif
+
+// ========================================================
+// createDirectoryAt():
+// ========================================================
+
+#if defined(_WIN32)
+bool createDirectoryAt(const DirectoryHandle & baseDir, const std::string & relativePath)
+{
+    return createDirectory(baseDir.path + relativePath);
+}
+#else
+bool createDirectoryAt(const DirectoryHandle & baseDir, const std::string & relativePath)
+{
+	assert(baseDir.fd >= 0);
+	assert(!relativePath.empty());
+
+	// Try creating first; only when it already exists do we need the extra stat.
+	if (mkdirat(baseDir.fd, relativePath.c_str(), 0777) == 0)
+	{
+		return true;
+	}
+	if (errno != EEXIST)
+	{
+		return false;
+	}
+
+	struct stat dirStat = {};
+	return fstatat(baseDir.fd, relativePath.c_str(), &dirStat, 0) == 0 && S_ISDIR(dirStat.st_mode);
+}
+#endif
+
+// ========================================================
+// openFileForWritingAt():
+// ========================================================
+
+#if defined(_WIN32)
+FILE * openFileForWritingAt(const DirectoryHandle & baseDir, const std::string & relativePath)
+{
+    return std::fopen((baseDir.path + relativePath).c_str(), "wb");
+}
+#else
+FILE * openFileForWritingAt(const DirectoryHandle & baseDir, const std::string & relativePath)
+{
+	assert(baseDir.fd >= 0);
+	assert(!relativePath.empty());
+
+	const int fd = openat(baseDir.fd, relativePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0)
+	{
+		return nullptr;
+	}
+
+	FILE * file = fdopen(fd, "wb");
+	if (file == nullptr)
+	{
+		::close(fd);
+	}
+	return file;
+}
+#endif
+
 // ========================================================
 // listFilesInPath():
 // ========================================================
@@ -234,6 +447,225 @@ std::vector<std::string> listFilesInPath(const std::string & dirPath, const bool
 	return fileList;
 }
 #endif
+
+// ========================================================
+// listFilesRecursive():
+// ========================================================
+
+#if defined(_WIN32)
+static void listFilesRecursiveImpl(const std::string & rootPath, const std::string & relDir,
+                                   const bool allowDotFiles, std::vector<ListedFile> & fileList)
+{
+    WIN32_FIND_DATAA fileData;
+    HANDLE hFind = FindFirstFileA((rootPath + "\\" + relDir + "*").c_str(), &fileData);
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        std::cerr << "Warning: Can't list directory \'" << rootPath << "\\" << relDir << "\'!\n";
+        return;
+    }
+
+    do {
+        const char * name = fileData.cFileName;
+        if (name[0] == '.' && (!allowDotFiles || name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        {
+            continue;
+        }
+
+        if (fileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            // Don't follow junctions and directory links.
+            if (!(fileData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+            {
+                listFilesRecursiveImpl(rootPath, relDir + name + "/", allowDotFiles, fileList);
+            }
+            continue;
+        }
+
+        // FILETIME counts 100ns intervals since 1601.
+        const std::uint64_t fileTime = (std::uint64_t(fileData.ftLastWriteTime.dwHighDateTime) << 32) |
+                                       fileData.ftLastWriteTime.dwLowDateTime;
+        const std::uint64_t fileSize = (std::uint64_t(fileData.nFileSizeHigh) << 32) | fileData.nFileSizeLow;
+
+        fileList.push_back({ relDir + name, fileSize, (std::int64_t(fileTime) - 116444736000000000LL) * 100 });
+    } while (FindNextFileA(hFind, &fileData));
+
+    FindClose(hFind);
+}
+
+std::vector<ListedFile> listFilesRecursive(const std::string & dirPath, int /* numThreads */, const bool allowDotFiles)
+{
+    assert(!dirPath.empty());
+    std::vector<ListedFile> fileList;
+
+    // FindFirstFile already returns sizes and times, so a serial walk is cheap enough.
+    std::string rootPath = dirPath;
+    if (rootPath.back() == '\\' || rootPath.back() == '/')
+    {
+        rootPath.pop_back();
+    }
+    listFilesRecursiveImpl(rootPath, "", allowDotFiles, fileList);
+
+    std::sort(std::begin(fileList), std::end(fileList),
+        [](const ListedFile & a, const ListedFile & b) { return a.path < b.path; });
+    return fileList;
+}
+#else
+// Lists one directory, relative to rootFd. Regular files go to fileList,
+// subdirectories to subDirs, both as paths relative to the root.
+static void scanDirectory(const int rootFd, const std::string & relDir, const bool allowDotFiles,
+                          std::vector<ListedFile> & fileList, std::vector<std::string> & subDirs)
+{
+	const int dirFd = openat(rootFd, (relDir.empty() ? "." : relDir.c_str()), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR * dirPtr = (dirFd >= 0) ? fdopendir(dirFd) : nullptr;
+	if (dirPtr == nullptr)
+	{
+		std::cerr << "Warning: Can't list directory \'" << relDir << "\': " << std::strerror(errno) << ".\n";
+		if (dirFd >= 0)
+		{
+			close(dirFd);
+		}
+		return;
+	}
+
+	while (const dirent * dEntry = readdir(dirPtr))
+	{
+		const char * name = dEntry->d_name;
+		if (name[0] == '.' && (!allowDotFiles || name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+		{
+			continue;
+		}
+
+		// d_type saves a stat for directories. Files need one anyway for the size.
+		const unsigned char type = dEntry->d_type;
+		if (type == DT_DIR)
+		{
+			subDirs.push_back(relDir + name + "/");
+			continue;
+		}
+		if (type != DT_REG && type != DT_LNK && type != DT_UNKNOWN)
+		{
+			continue; // Devices, pipes, sockets.
+		}
+
+		struct stat fileStats;
+		bool isLink = (type == DT_LNK);
+		if (fstatat(dirfd(dirPtr), name, &fileStats, (type == DT_UNKNOWN) ? AT_SYMLINK_NOFOLLOW : 0) != 0)
+		{
+			continue; // Dangling link or removed since readdir().
+		}
+		if (type == DT_UNKNOWN && S_ISLNK(fileStats.st_mode))
+		{
+			isLink = true;
+			if (fstatat(dirfd(dirPtr), name, &fileStats, 0) != 0)
+			{
+				continue;
+			}
+		}
+
+		if (S_ISDIR(fileStats.st_mode))
+		{
+			// Linked directories could form cycles, so only real ones are walked.
+			if (!isLink)
+			{
+				subDirs.push_back(relDir + name + "/");
+			}
+			continue;
+		}
+		if (!S_ISREG(fileStats.st_mode))
+		{
+			continue;
+		}
+
+		#if defined(__APPLE__)
+		const auto & modTime = fileStats.st_mtimespec;
+		#else
+		const auto & modTime = fileStats.st_mtim;
+		#endif
+
+		fileList.push_back({ relDir + name, static_cast<std::uint64_t>(fileStats.st_size),
+		                     std::int64_t(modTime.tv_sec) * 1000000000LL + modTime.tv_nsec });
+	}
+
+	closedir(dirPtr);
+}
+
+std::vector<ListedFile> listFilesRecursive(const std::string & dirPath, int numThreads, const bool allowDotFiles)
+{
+	assert(!dirPath.empty());
+	std::vector<ListedFile> fileList;
+
+	DirectoryHandle rootDir;
+	if (!openDirectory(dirPath, rootDir))
+	{
+		return fileList;
+	}
+
+	if (numThreads <= 0)
+	{
+		numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	}
+
+	//
+	// Directories found by any worker go into a shared stack that all
+	// workers pull from, so the walk spreads over the tree as it is found.
+	// The walk is done once the stack is empty and nobody is scanning.
+	//
+
+	std::mutex mutex;
+	std::condition_variable workChanged;
+	std::vector<std::string> pendingDirs{ "" };
+	int busyWorkers = 0;
+
+	const auto worker = [&]()
+	{
+		std::vector<ListedFile> found;
+		std::vector<std::string> subDirs;
+
+		std::unique_lock<std::mutex> lock{ mutex };
+		for (;;)
+		{
+			workChanged.wait(lock, [&]() { return !pendingDirs.empty() || busyWorkers == 0; });
+			if (pendingDirs.empty())
+			{
+				break;
+			}
+
+			const std::string relDir = std::move(pendingDirs.back());
+			pendingDirs.pop_back();
+			++busyWorkers;
+
+			lock.unlock();
+			scanDirectory(rootDir.fd, relDir, allowDotFiles, found, subDirs);
+			lock.lock();
+
+			--busyWorkers;
+			std::move(std::begin(subDirs), std::end(subDirs), std::back_inserter(pendingDirs));
+			subDirs.clear();
+			workChanged.notify_all();
+		}
+
+		std::move(std::begin(found), std::end(found), std::back_inserter(fileList));
+	};
+
+	std::vector<std::thread> threads;
+	for (int t = 1; t < numThreads; ++t)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto & thread : threads)
+	{
+		thread.join();
+	}
+
+	closeDirectory(rootDir);
+
+	std::sort(std::begin(fileList), std::end(fileList),
+		[](const ListedFile & a, const ListedFile & b) { return a.path < b.path; });
+	return fileList;
+}
+#endif
+
 // ========================================================
 // loadFile():
 // ========================================================
@@ -277,5 +709,544 @@ std::unique_ptr<std::uint8_t[]> loadFile(const std::string & filename, std::size
 	return data;
 }
 
+// ========================================================
+// setBinaryMode():
+// ========================================================
+
+#if defined(_WIN32)
+void setBinaryMode(FILE * stream)
+{
+    _setmode(_fileno(stream), _O_BINARY);
+}
+#else
+void setBinaryMode(FILE * /* stream */)
+{
+	// All streams are binary on POSIX.
+}
+#endif
+
+// ========================================================
+// readFileAt():
+// ========================================================
+
+#if defined(_WIN32)
+bool readFileAt(FILE * file, const std::uint64_t offset, void * dest, const std::size_t sizeInBytes)
+{
+    assert(file != nullptr);
+    assert(dest != nullptr);
+
+    HANDLE hFile = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+    auto * destBytes = static_cast<std::uint8_t *>(dest);
+    std::uint64_t position = offset;
+    std::size_t bytesLeft = sizeInBytes;
+
+    while (bytesLeft > 0)
+    {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset     = static_cast<DWORD>(position & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+
+        DWORD bytesRead = 0;
+        const DWORD chunk = static_cast<DWORD>(bytesLeft < 0x40000000 ? bytesLeft : 0x40000000);
+        if (!ReadFile(hFile, destBytes, chunk, &bytesRead, &overlapped) || bytesRead == 0)
+        {
+            return false;
+        }
+
+        destBytes += bytesRead;
+        position  += bytesRead;
+        bytesLeft -= bytesRead;
+    }
+    return true;
+}
+#else
+bool readFileAt(FILE * file, const std::uint64_t offset, void * dest, const std::size_t sizeInBytes)
+{
+	assert(file != nullptr);
+	assert(dest != nullptr);
+
+	const int fd = fileno(file);
+	auto * destBytes = static_cast<std::uint8_t *>(dest);
+	auto position = static_cast<off_t>(offset);
+	std::size_t bytesLeft = sizeInBytes;
+
+	while (bytesLeft > 0)
+	{
+		const ssize_t bytesRead = pread(fd, destBytes, bytesLeft, position);
+		if (bytesRead < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (bytesRead <= 0) // Error or unexpected EOF.
+		{
+			return false;
+		}
+
+		destBytes += bytesRead;
+		position  += bytesRead;
+		bytesLeft -= static_cast<std::size_t>(bytesRead);
+	}
+	return true;
+}
+#endif
+
+// ========================================================
+// writeFileAt():
+// ========================================================
+
+#if defined(_WIN32)
+bool writeFileAt(FILE * file, const std::uint64_t offset, const void * src, const std::size_t sizeInBytes)
+{
+    assert(file != nullptr);
+    assert(src  != nullptr);
+
+    HANDLE hFile = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+    const auto * srcBytes = static_cast<const std::uint8_t *>(src);
+    std::uint64_t position = offset;
+    std::size_t bytesLeft = sizeInBytes;
+
+    while (bytesLeft > 0)
+    {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset     = static_cast<DWORD>(position & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+
+        DWORD bytesWritten = 0;
+        const DWORD chunk = static_cast<DWORD>(bytesLeft < 0x40000000 ? bytesLeft : 0x40000000);
+        if (!WriteFile(hFile, srcBytes, chunk, &bytesWritten, &overlapped) || bytesWritten == 0)
+        {
+            return false;
+        }
+
+        srcBytes  += bytesWritten;
+        position  += bytesWritten;
+        bytesLeft -= bytesWritten;
+    }
+    return true;
+}
+#else
+bool writeFileAt(FILE * file, const std::uint64_t offset, const void * src, const std::size_t sizeInBytes)
+{
+	assert(file != nullptr);
+	assert(src  != nullptr);
+
+	const int fd = fileno(file);
+	const auto * srcBytes = static_cast<const std::uint8_t *>(src);
+	auto position = static_cast<off_t>(offset);
+	std::size_t bytesLeft = sizeInBytes;
+
+	while (bytesLeft > 0)
+	{
+		const ssize_t bytesWritten = pwrite(fd, srcBytes, bytesLeft, position);
+		if (bytesWritten < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (bytesWritten <= 0)
+		{
+			return false;
+		}
+
+		srcBytes  += bytesWritten;
+		position  += bytesWritten;
+		bytesLeft -= static_cast<std::size_t>(bytesWritten);
+	}
+	return true;
+}
+#endif
+
+// ========================================================
+// preallocateFile():
+// ========================================================
+
+#if defined(_WIN32)
+bool preallocateFile(FILE * file, const std::uint64_t sizeInBytes)
+{
+    assert(file != nullptr);
+    std::fflush(file);
+    return _chsize_s(_fileno(file), static_cast<__int64>(sizeInBytes)) == 0;
+}
+#else
+bool preallocateFile(FILE * file, const std::uint64_t sizeInBytes)
+{
+	assert(file != nullptr);
+	std::fflush(file);
+
+	const int fd = fileno(file);
+	if (sizeInBytes == 0)
+	{
+		return true;
+	}
+
+	#if defined(__linux__)
+	// Returns the error code rather than setting errno. Some file systems
+	// (tmpfs on old kernels, NFS) don't support it; just extend the file then.
+	const int result = posix_fallocate(fd, 0, static_cast<off_t>(sizeInBytes));
+	if (result == 0)
+	{
+		return true;
+	}
+	if (result != EOPNOTSUPP && result != ENOSYS && result != EINVAL)
+	{
+		std::cerr << "posix_fallocate() failed: " << std::strerror(result) << "\n";
+		return false;
+	}
+	#endif
+
+	struct stat fileStats;
+	if (fstat(fd, &fileStats) != 0)
+	{
+		return false;
+	}
+	if (static_cast<std::uint64_t>(fileStats.st_size) >= sizeInBytes)
+	{
+		return true;
+	}
+	return ftruncate(fd, static_cast<off_t>(sizeInBytes)) == 0;
+}
+#endif
+
+// ========================================================
+// copyFileRange():
+// ========================================================
+
+#if defined(_WIN32)
+bool copyFileRange(FILE * srcFile, const std::uint64_t srcOffset, FILE * destFile, const std::size_t sizeInBytes)
+{
+    assert(srcFile  != nullptr);
+    assert(destFile != nullptr);
+
+    std::uint8_t buffer[64 * 1024];
+    std::uint64_t offset = srcOffset;
+    std::size_t bytesLeft = sizeInBytes;
+
+    while (bytesLeft > 0)
+    {
+        const std::size_t chunk = (bytesLeft < sizeof(buffer)) ? bytesLeft : sizeof(buffer);
+        if (!readFileAt(srcFile, offset, buffer, chunk) ||
+            std::fwrite(buffer, sizeof(std::uint8_t), chunk, destFile) != chunk)
+        {
+            return false;
+        }
+        offset    += chunk;
+        bytesLeft -= chunk;
+    }
+    return true;
+}
+#else
+#if defined(__linux__)
+// Set once the kernel turns out not to have a copy call at all,
+// so we don't keep paying for a failing syscall per file.
+static std::atomic<bool> noCopyFileRange{ false };
+static std::atomic<bool> noSendFile{ false };
+
+// The copy call can't handle this pair of files, e.g. across file systems on
+// older kernels, an O_APPEND output or a file system without support for it.
+// Only this copy falls back; the next pair of files may be fine.
+static bool isUnsupportedCopyError(const int error)
+{
+	return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP;
+}
+#endif // __linux__
+
+bool copyFileRange(FILE * srcFile, const std::uint64_t srcOffset, FILE * destFile, const std::size_t sizeInBytes)
+{
+	assert(srcFile  != nullptr);
+	assert(destFile != nullptr);
+
+	// All writes below go straight to the descriptor, so push out anything still buffered.
+	if (std::fflush(destFile) != 0)
+	{
+		return false;
+	}
+
+	const int srcFd  = fileno(srcFile);
+	const int destFd = fileno(destFile);
+	auto offset = static_cast<off_t>(srcOffset);
+	std::size_t bytesLeft = sizeInBytes;
+
+	#if defined(__linux__)
+	while (bytesLeft > 0 && !noCopyFileRange)
+	{
+		const ssize_t copied = copy_file_range(srcFd, &offset, destFd, nullptr, bytesLeft, 0);
+		if (copied > 0)
+		{
+			bytesLeft -= static_cast<std::size_t>(copied);
+			continue;
+		}
+		if (copied < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (copied < 0 && isUnsupportedCopyError(errno))
+		{
+			// Nothing was copied by the failing call, so just try the next method.
+			if (errno == ENOSYS)
+			{
+				noCopyFileRange = true;
+			}
+			break;
+		}
+		return false; // Real error or unexpected EOF.
+	}
+
+	while (bytesLeft > 0 && !noSendFile)
+	{
+		const ssize_t copied = sendfile(destFd, srcFd, &offset, bytesLeft);
+		if (copied > 0)
+		{
+			bytesLeft -= static_cast<std::size_t>(copied);
+			continue;
+		}
+		if (copied < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (copied < 0 && isUnsupportedCopyError(errno))
+		{
+			if (errno == ENOSYS)
+			{
+				noSendFile = true;
+			}
+			break;
+		}
+		return false;
+	}
+	#endif // __linux__
+
+	// Buffered fallback for whatever is left.
+	std::uint8_t buffer[64 * 1024];
+	while (bytesLeft > 0)
+	{
+		const std::size_t chunk = (bytesLeft < sizeof(buffer)) ? bytesLeft : sizeof(buffer);
+		if (!readFileAt(srcFile, static_cast<std::uint64_t>(offset), buffer, chunk))
+		{
+			return false;
+		}
+
+		std::size_t written = 0;
+		while (written < chunk)
+		{
+			const ssize_t result = write(destFd, buffer + written, chunk - written);
+			if (result < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (result <= 0)
+			{
+				return false;
+			}
+			written += static_cast<std::size_t>(result);
+		}
+
+		offset    += static_cast<off_t>(chunk);
+		bytesLeft -= chunk;
+	}
+	return true;
+}
+#endif
+
+// ========================================================
+// copyFileRangeAt():
+// ========================================================
+
+bool copyFileRangeAt(FILE * srcFile, const std::uint64_t srcOffset, FILE * destFile,
+                     const std::uint64_t destOffset, const std::size_t sizeInBytes)
+{
+	assert(srcFile  != nullptr);
+	assert(destFile != nullptr);
+
+	std::uint64_t inOffset  = srcOffset;
+	std::uint64_t outOffset = destOffset;
+	std::size_t bytesLeft   = sizeInBytes;
+
+	#if defined(__linux__)
+	const int srcFd  = fileno(srcFile);
+	const int destFd = fileno(destFile);
+
+	while (bytesLeft > 0 && !noCopyFileRange)
+	{
+		auto offIn  = static_cast<off_t>(inOffset);
+		auto offOut = static_cast<off_t>(outOffset);
+
+		const ssize_t copied = copy_file_range(srcFd, &offIn, destFd, &offOut, bytesLeft, 0);
+		if (copied > 0)
+		{
+			inOffset  += static_cast<std::uint64_t>(copied);
+			outOffset += static_cast<std::uint64_t>(copied);
+			bytesLeft -= static_cast<std::size_t>(copied);
+			continue;
+		}
+		if (copied < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (copied < 0 && isUnsupportedCopyError(errno))
+		{
+			if (errno == ENOSYS)
+			{
+				noCopyFileRange = true;
+			}
+			break;
+		}
+		return false; // Real error or unexpected EOF.
+	}
+	#endif // __linux__
+
+	// Buffered fallback for whatever is left. sendfile() can't write
+	// at an offset without moving the shared file position, so no use here.
+	std::uint8_t buffer[64 * 1024];
+	while (bytesLeft > 0)
+	{
+		const std::size_t chunk = (bytesLeft < sizeof(buffer)) ? bytesLeft : sizeof(buffer);
+		if (!readFileAt(srcFile, inOffset, buffer, chunk) ||
+		    !writeFileAt(destFile, outOffset, buffer, chunk))
+		{
+			return false;
+		}
+		inOffset  += chunk;
+		outOffset += chunk;
+		bytesLeft -= chunk;
+	}
+	return true;
+}
+
+// ========================================================
+// mapFile() / unmapFile():
+// ========================================================
+
+#if defined(_WIN32)
+const std::uint8_t * mapFile(FILE * file, const std::size_t sizeInBytes)
+{
+    assert(file != nullptr);
+    assert(sizeInBytes != 0);
+
+    HANDLE hFile = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+    HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (hMapping == nullptr)
+    {
+        std::cerr << "CreateFileMapping() failed: " << GetLastError() << ".\n";
+        return nullptr;
+    }
+
+    // The view keeps the mapping object alive, so the handle can go now.
+    void * view = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, sizeInBytes);
+    CloseHandle(hMapping);
+
+    if (view == nullptr)
+    {
+        std::cerr << "MapViewOfFile() failed: " << GetLastError() << ".\n";
+        return nullptr;
+    }
+    return static_cast<const std::uint8_t *>(view);
+}
+
+void unmapFile(const std::uint8_t * mappedData, std::size_t /* sizeInBytes */)
+{
+    if (mappedData != nullptr)
+    {
+        UnmapViewOfFile(mappedData);
+    }
+}
+
+std::size_t getMappingGranularity()
+{
+    SYSTEM_INFO sysInfo;
+    GetSystemInfo(&sysInfo);
+    return sysInfo.dwAllocationGranularity;
+}
+
+const std::uint8_t * mapFileRange(FILE * file, const std::uint64_t offset, const std::size_t sizeInBytes,
+                                  const std::uint8_t *& mappedBase, std::size_t & mappedSize)
+{
+    assert(file != nullptr);
+    assert(sizeInBytes != 0);
+
+    mappedBase = nullptr;
+    mappedSize = 0;
+
+    const std::uint64_t granularity = getMappingGranularity();
+    const std::uint64_t mapOffset   = offset / granularity * granularity;
+    const std::size_t   viewSize    = static_cast<std::size_t>(offset - mapOffset) + sizeInBytes;
+
+    HANDLE hFile = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+    HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (hMapping == nullptr)
+    {
+        std::cerr << "CreateFileMapping() failed: " << GetLastError() << ".\n";
+        return nullptr;
+    }
+
+    void * view = MapViewOfFile(hMapping, FILE_MAP_READ, static_cast<DWORD>(mapOffset >> 32),
+                                static_cast<DWORD>(mapOffset & 0xFFFFFFFF), viewSize);
+    CloseHandle(hMapping);
+
+    if (view == nullptr)
+    {
+        std::cerr << "MapViewOfFile() failed: " << GetLastError() << ".\n";
+        return nullptr;
+    }
+
+    mappedBase = static_cast<const std::uint8_t *>(view);
+    mappedSize = viewSize;
+    return mappedBase + (offset - mapOffset);
+}
+#else
+const std::uint8_t * mapFile(FILE * file, const std::size_t sizeInBytes)
+{
+	assert(file != nullptr);
+	assert(sizeInBytes != 0);
+
+	errno = 0;
+	void * mapping = mmap(nullptr, sizeInBytes, PROT_READ, MAP_SHARED, fileno(file), 0);
+	if (mapping == MAP_FAILED)
+	{
+		std::cerr << "mmap() failed: " << std::strerror(errno) << ".\n";
+		return nullptr;
+	}
+	return static_cast<const std::uint8_t *>(mapping);
+}
+
+void unmapFile(const std::uint8_t * mappedData, const std::size_t sizeInBytes)
+{
+	if (mappedData != nullptr)
+	{
+		munmap(const_cast<std::uint8_t *>(mappedData), sizeInBytes);
+	}
+}
+
+std::size_t getMappingGranularity()
+{
+	static const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	return pageSize;
+}
+
+const std::uint8_t * mapFileRange(FILE * file, const std::uint64_t offset, const std::size_t sizeInBytes,
+                                  const std::uint8_t *& mappedBase, std::size_t & mappedSize)
+{
+	assert(file != nullptr);
+	assert(sizeInBytes != 0);
+
+	mappedBase = nullptr;
+	mappedSize = 0;
+
+	const std::uint64_t granularity = getMappingGranularity();
+	const std::uint64_t mapOffset   = offset / granularity * granularity;
+	const std::size_t   viewSize    = static_cast<std::size_t>(offset - mapOffset) + sizeInBytes;
+
+	errno = 0;
+	void * mapping = mmap(nullptr, viewSize, PROT_READ, MAP_SHARED, fileno(file), static_cast<off_t>(mapOffset));
+	if (mapping == MAP_FAILED)
+	{
+		std::cerr << "mmap() failed: " << std::strerror(errno) << ".\n";
+		return nullptr;
+	}
+
+	mappedBase = static_cast<const std::uint8_t *>(mapping);
+	mappedSize = viewSize;
+	return mappedBase + (offset - mapOffset);
+}
+#endif
+
 } // namespace filesys {}
 } // namespace ol {}
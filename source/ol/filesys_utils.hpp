@@ -30,6 +30,22 @@ namespace ol
 namespace filesys
 {
 
+// An open directory used as the base for the *At() functions below, so
+// relative paths are resolved without walking the full path every time.
+struct DirectoryHandle
+{
+	int         fd = -1; // Directory descriptor on POSIX systems.
+	std::string path;    // Directory path, ending with a separator.
+};
+
+// A regular file found by listFilesRecursive().
+struct ListedFile
+{
+	std::string   path;         // Relative to the listed directory, '/' separated.
+	std::uint64_t sizeInBytes;
+	std::int64_t  modifiedTime; // Nanoseconds since the Unix epoch.
+};
+
 // Get the common path separator as a string ("/").
 const char * getPathSeparator() noexcept;
 
@@ -39,19 +55,101 @@ std::string getFilenameExtension(const std::string & filename, bool includeDot =
 // Get the size in byte of a file. Zero and false if the file doesn't exist.
 bool queryFileSize(const std::string & filename, std::size_t & sizeInBytes);
 
+// Last modification time of a file in nanoseconds since the Unix epoch,
+// like ListedFile::modifiedTime. Zero and false if the file doesn't exist.
+bool queryFileModifiedTime(const std::string & filename, std::int64_t & modifiedTime);
+
 // Create a single directory. No side effects is the dir already exists.
 bool createDirectory(const std::string & dirPath);
 
 // Create a full path of directories. No side effects if the path already exists.
 bool createPath(const std::string & pathEndedWithSeparatorOrFilename);
 
+// Remove a single empty directory. Returns false if it isn't empty or doesn't exist.
+bool removeDirectory(const std::string & dirPath);
+
+// Rename srcFile to destFile, replacing destFile if it exists. Atomic on POSIX
+// file systems when both are in the same directory. Returns false on error.
+bool replaceFile(const std::string & srcFile, const std::string & destFile);
+
+// Open an existing directory as a base for relative paths. Must be
+// released with closeDirectory(). Returns false on error and logs to STDERR.
+bool openDirectory(const std::string & dirPath, DirectoryHandle & dirHandle);
+void closeDirectory(DirectoryHandle & dirHandle);
+
+// Create a single directory relative to baseDir. Its parent must already exist.
+// No side effects if the directory already exists.
+bool createDirectoryAt(const DirectoryHandle & baseDir, const std::string & relativePath);
+
+// Open a file relative to baseDir for binary writing, truncating it if it exists.
+// Returns null on error. The parent directory must already exist.
+FILE * openFileForWritingAt(const DirectoryHandle & baseDir, const std::string & relativePath);
+
 // Get a list of all files in a directory. Can optionally ignore or add files starting
 // with a dot (hidden files on Unix). Returns an empty list if an error occurs and logs to STDERR.
 std::vector<std::string> listFilesInPath(const std::string & dirPath, bool allowDotFiles = false);
 
+// Recursively list all regular files under a directory, with their sizes and
+// modification times. Subdirectories are scanned in parallel by up to numThreads
+// threads (zero = one per CPU core). Symbolic links to files are followed, links
+// to directories are not. The result is sorted by path. Unreadable directories
+// are skipped with a warning. Dot files and dirs are skipped unless allowDotFiles.
+std::vector<ListedFile> listFilesRecursive(const std::string & dirPath, int numThreads = 0, bool allowDotFiles = false);
+
 // Load the whole file into memory, treat as a binary file. Returns null on error.
 std::unique_ptr<std::uint8_t[]> loadFile(const std::string & filename, std::size_t * sizeInBytes = nullptr);
 
+// Switch an already open stream, such as STDIN, to binary mode. No-op on POSIX systems.
+void setBinaryMode(FILE * stream);
+
+// Read sizeInBytes from an open file starting at an absolute offset, without
+// touching the file's current position. Safe to call from multiple threads on
+// the same handle. Returns false on error or short read.
+bool readFileAt(FILE * file, std::uint64_t offset, void * dest, std::size_t sizeInBytes);
+
+// Write sizeInBytes to an open file at an absolute offset, without touching the
+// file's current position. Safe to call from multiple threads on the same handle,
+// as long as the ranges written don't overlap. Returns false on error.
+bool writeFileAt(FILE * file, std::uint64_t offset, const void * src, std::size_t sizeInBytes);
+
+// Reserve disk space for an open file so that it is at least sizeInBytes long.
+// Uses posix_fallocate where supported, so later writes won't fail for lack of
+// space or fragment the file; otherwise just extends it. Returns false on error.
+bool preallocateFile(FILE * file, std::uint64_t sizeInBytes);
+
+// Copy sizeInBytes from srcFile, starting at the absolute srcOffset, to the current
+// position of destFile. Uses kernel-side copies where available (copy_file_range, then
+// sendfile on Linux), which can share blocks on reflink-capable file systems. Falls back
+// to a buffered read/write loop otherwise. Does not move srcFile's position, so it is
+// safe to call from multiple threads sharing srcFile. Returns false on error.
+bool copyFileRange(FILE * srcFile, std::uint64_t srcOffset, FILE * destFile, std::size_t sizeInBytes);
+
+// Like copyFileRange(), but writes at the absolute destOffset of destFile instead of its
+// current position, leaving both positions alone. Safe to call from multiple threads
+// sharing destFile, as long as the ranges written don't overlap. On Linux, tries
+// copy_file_range first; otherwise copies through a buffer. Returns false on error.
+bool copyFileRangeAt(FILE * srcFile, std::uint64_t srcOffset, FILE * destFile,
+                     std::uint64_t destOffset, std::size_t sizeInBytes);
+
+// Map the first sizeInBytes of an open file into memory for read-only access.
+// The mapping is shared, so other processes mapping the same file share its pages.
+// Must be released with unmapFile(). Returns null on error and logs to STDERR.
+const std::uint8_t * mapFile(FILE * file, std::size_t sizeInBytes);
+
+// Release a mapping previously returned by mapFile(). Null pointers are ignored.
+void unmapFile(const std::uint8_t * mappedData, std::size_t sizeInBytes);
+
+// Alignment required of file offsets passed to the OS mapping call. The page
+// size on POSIX systems, the allocation granularity (usually 64KB) on Windows.
+std::size_t getMappingGranularity();
+
+// Map sizeInBytes of an open file for read-only access, starting at any offset.
+// The mapping itself starts at the nearest granularity boundary at or below offset;
+// mappedBase and mappedSize receive it, for unmapFile(). Returns a pointer to the
+// byte at offset, or null on error (logged to STDERR).
+const std::uint8_t * mapFileRange(FILE * file, std::uint64_t offset, std::size_t sizeInBytes,
+                                  const std::uint8_t *& mappedBase, std::size_t & mappedSize);
+
 } // namespace filesys {}
 } // namespace ol {}
 
@@ -0,0 +1,654 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_archive_editor.cpp
+// Created on: 16/10/26
+// Brief: Incremental add/replace/remove of entries in an existing LucasArts LAB archive.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#include "lab_archive_editor.hpp"
+#include "lab_archive_reader.hpp"
+#include "lab_common.hpp"
+#include "filesys_utils.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+
+namespace ol
+{
+
+// ========================================================
+// class LabArchiveEditor:
+// ========================================================
+
+LabArchiveEditor::LabArchiveEditor(std::string filename)
+	: labFile          { nullptr }
+	, labFileName      { std::move(filename) }
+	, labHeaderUnknown { 0x10000 }
+	, fileSize         { 0 }
+	, metadataCapacity { 0 }
+	, entries          { }
+	, freeRanges       { }
+	, pinnedRanges     { }
+	, modified         { false }
+	, nameIndex        { }
+	, nameIndexDirty   { true }
+{
+	assert(!labFileName.empty());
+}
+
+LabArchiveEditor::~LabArchiveEditor()
+{
+	close();
+}
+
+bool LabArchiveEditor::open()
+{
+	close();
+
+	// Let the reader validate the table; entries it rejects are dropped on the next commit.
+	LabArchiveReader labReader { labFileName, LabArchiveReader::OpenMode::MetadataOnly };
+	if (!labReader.open())
+	{
+		return false;
+	}
+
+	labFile = std::fopen(labFileName.c_str(), "r+b");
+	if (labFile == nullptr)
+	{
+		std::cerr << "Failed to open LAB archive " << labFileName << " for editing!\n";
+		return false;
+	}
+
+	LabHeader labHeader;
+	std::size_t labSize = 0;
+	if (!filesys::readFileAt(labFile, 0, &labHeader, sizeof(labHeader)) ||
+	    !filesys::queryFileSize(labFileName, labSize))
+	{
+		std::cerr << "Failed to read LAB header! " << labFileName << ".\n";
+		close();
+		return false;
+	}
+
+	labHeaderUnknown = labHeader.unknown;
+	fileSize         = labSize;
+	metadataCapacity = sizeof(LabHeader) +
+		(static_cast<std::uint64_t>(labHeader.fileCount) * sizeof(LabFileEntry)) + labHeader.fileNameListLength;
+
+	entries.resize(labReader.getEntryCount());
+	for (std::size_t i = 0; i < entries.size(); ++i)
+	{
+		auto & entry       = entries[i];
+		entry.name         = labReader.getEntryName(i);
+		entry.dataOffset   = labReader.getEntryDataOffset(i);
+		entry.sizeInBytes  = static_cast<std::uint32_t>(labReader.getEntrySize(i));
+		std::memcpy(entry.typeId, labReader.getEntryTypeId(i), sizeof(entry.typeId));
+	}
+
+	// Rejected entries are still in the table on disk, so their data can't be reused before a commit.
+	if (labReader.getRejectedEntryCount() != 0)
+	{
+		std::vector<LabFileEntry> labEntries(labHeader.fileCount);
+		if (!filesys::readFileAt(labFile, sizeof(LabHeader), labEntries.data(), labEntries.size() * sizeof(LabFileEntry)))
+		{
+			std::cerr << "Failed to read LAB entry table! " << labFileName << ".\n";
+			close();
+			return false;
+		}
+		for (const auto & labEntry : labEntries)
+		{
+			const std::uint64_t start = std::min<std::uint64_t>(labEntry.dataOffset, fileSize);
+			const std::uint64_t end   = std::min<std::uint64_t>(start + labEntry.sizeInBytes, fileSize);
+			if (end > start)
+			{
+				pinnedRanges.push_back({ start, end - start });
+			}
+		}
+	}
+
+	nameIndexDirty = true;
+	modified = false;
+	rebuildFreeRanges();
+	return true;
+}
+
+void LabArchiveEditor::close()
+{
+	if (labFile != nullptr)
+	{
+		std::fclose(labFile);
+		labFile = nullptr;
+	}
+
+	entries.clear();
+	freeRanges.clear();
+	pinnedRanges.clear();
+	nameIndex.clear();
+	nameIndexDirty   = true;
+	fileSize         = 0;
+	metadataCapacity = 0;
+	modified         = false;
+}
+
+bool LabArchiveEditor::hasEntry(const std::string & entryName) const
+{
+	return findEntryIndex(entryName) < entries.size();
+}
+
+bool LabArchiveEditor::addEntry(const std::string & entryName, const void * data, const std::size_t sizeInBytes)
+{
+	return putEntry(entryName, false, data, sizeInBytes, nullptr);
+}
+
+bool LabArchiveEditor::addEntryFromFile(const std::string & entryName, const std::string & sourceFile)
+{
+	return putEntry(entryName, false, nullptr, 0, &sourceFile);
+}
+
+bool LabArchiveEditor::replaceEntry(const std::string & entryName, const void * data, const std::size_t sizeInBytes)
+{
+	return putEntry(entryName, true, data, sizeInBytes, nullptr);
+}
+
+bool LabArchiveEditor::replaceEntryFromFile(const std::string & entryName, const std::string & sourceFile)
+{
+	return putEntry(entryName, true, nullptr, 0, &sourceFile);
+}
+
+bool LabArchiveEditor::removeEntry(const std::string & entryName)
+{
+	assert(isOpen());
+
+	const std::size_t index = findEntryIndex(entryName);
+	if (index == entries.size())
+	{
+		std::cerr << "No entry \'" << entryName << "\' in LAB archive " << labFileName << "!\n";
+		return false;
+	}
+
+	// The data stays where it is; its range is only considered free after the next commit.
+	entries.erase(entries.begin() + index);
+	nameIndexDirty = true;
+	modified = true;
+	return true;
+}
+
+bool LabArchiveEditor::commit()
+{
+	assert(isOpen());
+	if (!modified)
+	{
+		return true;
+	}
+
+	const std::uint64_t metadataSize = computeMetadataSize();
+	if (metadataSize > metadataCapacity)
+	{
+		// Leave some slack, so that a few more adds don't have to move data again.
+		if (!relocateEntriesBelow(metadataSize + metadataSize / 2))
+		{
+			return false;
+		}
+	}
+
+	const auto metadata = buildMetadata(entries);
+	if (!filesys::writeFileAt(labFile, 0, metadata.data(), metadata.size()) || std::fflush(labFile) != 0)
+	{
+		std::cerr << "Failed to write LAB entry table! " << labFileName << ".\n";
+		return false;
+	}
+
+	// Space of removed, replaced and rejected entries is reusable from now on.
+	pinnedRanges.clear();
+	rebuildFreeRanges();
+	modified = false;
+	return true;
+}
+
+bool LabArchiveEditor::compact()
+{
+	assert(isOpen());
+
+	//
+	// Lay the entries out back to back after the metadata, in table order,
+	// and copy them into a new file. Entries that share data keep sharing it.
+	// Only once the new archive is complete does it replace the old one.
+	//
+
+	const std::string tempFileName = labFileName + ".tmp";
+	const std::uint64_t metadataSize = computeMetadataSize();
+
+	struct DataCopy
+	{
+		std::uint32_t srcOffset;
+		std::uint32_t destOffset;
+		std::uint32_t sizeInBytes;
+	};
+
+	std::vector<Entry> newEntries = entries;
+	std::vector<DataCopy> dataCopies;
+	std::unordered_map<std::uint64_t, std::uint32_t> movedOffsets;
+	std::uint64_t dataOffset = metadataSize;
+
+	for (auto & entry : newEntries)
+	{
+		if (entry.sizeInBytes == 0)
+		{
+			entry.dataOffset = 0; // Nothing to read, any offset inside the file will do.
+			continue;
+		}
+
+		const std::uint64_t key = (std::uint64_t(entry.dataOffset) << 32) | entry.sizeInBytes;
+		auto iter = movedOffsets.find(key);
+		if (iter != movedOffsets.end())
+		{
+			entry.dataOffset = iter->second;
+			continue;
+		}
+
+		const auto newOffset = static_cast<std::uint32_t>(dataOffset);
+		movedOffsets.emplace(key, newOffset);
+		dataCopies.push_back({ entry.dataOffset, newOffset, entry.sizeInBytes });
+
+		entry.dataOffset = newOffset;
+		dataOffset += entry.sizeInBytes;
+	}
+
+	FILE * fileOut = std::fopen(tempFileName.c_str(), "wb");
+	if (fileOut == nullptr)
+	{
+		std::cerr << "Failed to open file " << tempFileName << " for writing!\n";
+		return false;
+	}
+
+	const auto metadata = buildMetadata(newEntries);
+	bool ok = filesys::preallocateFile(fileOut, dataOffset) &&
+	          filesys::writeFileAt(fileOut, 0, metadata.data(), metadata.size());
+
+	for (std::size_t i = 0; ok && i < dataCopies.size(); ++i)
+	{
+		const auto & copy = dataCopies[i];
+		ok = filesys::copyFileRangeAt(labFile, copy.srcOffset, fileOut, copy.destOffset, copy.sizeInBytes);
+	}
+
+	if (std::fclose(fileOut) != 0 || !ok)
+	{
+		std::cerr << "Failed to write compacted LAB archive " << tempFileName << "!\n";
+		std::remove(tempFileName.c_str());
+		return false;
+	}
+
+	std::fclose(labFile);
+	labFile = nullptr;
+
+	if (!filesys::replaceFile(tempFileName, labFileName))
+	{
+		std::cerr << "Failed to replace " << labFileName << " with the compacted archive!\n";
+		std::remove(tempFileName.c_str());
+		close();
+		return false;
+	}
+
+	return open();
+}
+
+std::uint64_t LabArchiveEditor::getDeadSpace() const
+{
+	std::uint64_t deadSpace = 0;
+	for (const auto & range : freeRanges)
+	{
+		deadSpace += range.size;
+	}
+
+	// Reserved room for the metadata to grow into isn't in the free list.
+	// Adds not committed yet can make the table outgrow it, leaving none.
+	const std::uint64_t metadataSize = computeMetadataSize();
+	return deadSpace + ((metadataSize < metadataCapacity) ? (metadataCapacity - metadataSize) : 0);
+}
+
+std::size_t LabArchiveEditor::findEntryIndex(const std::string & entryName) const
+{
+	if (nameIndexDirty)
+	{
+		rebuildNameIndex();
+	}
+
+	const auto index = nameIndex.find(entryName);
+	return (index == LabNameIndex::NotFound) ? entries.size() : index;
+}
+
+void LabArchiveEditor::rebuildNameIndex() const
+{
+	nameIndex.reset(entries.size());
+	for (std::size_t i = 0; i < entries.size(); ++i)
+	{
+		nameIndex.insert(entries[i].name.data(), entries[i].name.length(), static_cast<std::uint32_t>(i));
+	}
+	nameIndexDirty = false;
+}
+
+bool LabArchiveEditor::putEntry(const std::string & entryName, const bool mustExist, const void * data,
+                                std::size_t sizeInBytes, const std::string * sourceFile)
+{
+	assert(isOpen());
+
+	if (entryName.empty())
+	{
+		std::cerr << "Invalid LAB entry name \'" << entryName << "\'!\n";
+		return false;
+	}
+
+	const std::size_t index = findEntryIndex(entryName);
+	if (mustExist && index == entries.size())
+	{
+		std::cerr << "No entry \'" << entryName << "\' in LAB archive " << labFileName << "!\n";
+		return false;
+	}
+	if (!mustExist && index != entries.size())
+	{
+		std::cerr << "Entry \'" << entryName << "\' already exists in LAB archive " << labFileName << "!\n";
+		return false;
+	}
+
+	FILE * fileIn = nullptr;
+	if (sourceFile != nullptr)
+	{
+		if (!filesys::queryFileSize(*sourceFile, sizeInBytes) ||
+		    (fileIn = std::fopen(sourceFile->c_str(), "rb")) == nullptr)
+		{
+			std::cerr << "Failed to open file \'" << *sourceFile << "\' for reading!\n";
+			return false;
+		}
+	}
+
+	// Never overwrites data the table on disk still refers to.
+	std::uint64_t dataOffset = 0;
+	bool ok = true;
+	if (sizeInBytes != 0)
+	{
+		ok = allocateSpace(sizeInBytes, dataOffset);
+		if (ok)
+		{
+			ok = (fileIn != nullptr) ?
+				filesys::copyFileRangeAt(fileIn, 0, labFile, dataOffset, sizeInBytes) :
+				filesys::writeFileAt(labFile, dataOffset, data, sizeInBytes);
+
+			if (!ok)
+			{
+				std::cerr << "Failed to write data of entry \'" << entryName << "\'! " << labFileName << ".\n";
+				releaseSpace(dataOffset, sizeInBytes);
+			}
+		}
+	}
+
+	if (fileIn != nullptr)
+	{
+		std::fclose(fileIn);
+	}
+	if (!ok)
+	{
+		return false;
+	}
+
+	if (index != entries.size())
+	{
+		entries[index].dataOffset  = static_cast<std::uint32_t>(dataOffset);
+		entries[index].sizeInBytes = static_cast<std::uint32_t>(sizeInBytes);
+	}
+	else
+	{
+		const auto oldCapacity = entries.capacity();
+
+		// Same separators as LabArchiveWriter, so edited and packed names match.
+		Entry entry;
+		entry.name        = entryName;
+		entry.dataOffset  = static_cast<std::uint32_t>(dataOffset);
+		entry.sizeInBytes = static_cast<std::uint32_t>(sizeInBytes);
+		std::replace(std::begin(entry.name), std::end(entry.name), '/', '\\');
+		fileTypeIdForFileName(entry.typeId, entry.name, labFileName);
+		entries.push_back(std::move(entry));
+
+		// Growing the vector moves the strings the index points into.
+		if (entries.capacity() != oldCapacity || nameIndexDirty)
+		{
+			nameIndexDirty = true;
+		}
+		else
+		{
+			const auto & name = entries.back().name;
+			nameIndex.insert(name.data(), name.length(), static_cast<std::uint32_t>(entries.size() - 1));
+		}
+	}
+
+	modified = true;
+	return true;
+}
+
+bool LabArchiveEditor::allocateSpace(const std::uint64_t sizeInBytes, std::uint64_t & offset)
+{
+	assert(sizeInBytes != 0);
+
+	for (auto iter = freeRanges.begin(); iter != freeRanges.end(); ++iter)
+	{
+		if (iter->size >= sizeInBytes)
+		{
+			offset = iter->offset;
+			iter->offset += sizeInBytes;
+			iter->size   -= sizeInBytes;
+			if (iter->size == 0)
+			{
+				freeRanges.erase(iter);
+			}
+			return true;
+		}
+	}
+
+	// All offsets and sizes in a LAB are 32-bits.
+	if (fileSize + sizeInBytes > UINT32_MAX)
+	{
+		std::cerr << "LAB archive " << labFileName << " would exceed the 4GB limit of the format!\n";
+		return false;
+	}
+
+	// Grow the file right away, so fileSize is always its real length.
+	if (!filesys::preallocateFile(labFile, fileSize + sizeInBytes))
+	{
+		std::cerr << "Failed to grow LAB archive " << labFileName << "!\n";
+		return false;
+	}
+
+	offset = fileSize;
+	fileSize += sizeInBytes;
+	return true;
+}
+
+void LabArchiveEditor::releaseSpace(const std::uint64_t offset, const std::uint64_t sizeInBytes)
+{
+	assert(sizeInBytes != 0);
+
+	// Even a range taken from the end of the file stays allocated on disk,
+	// so it goes back into the sorted list, merged with the gaps on either side.
+	auto iter = std::lower_bound(std::begin(freeRanges), std::end(freeRanges), offset,
+		[](const Range & range, const std::uint64_t off) { return range.offset < off; });
+	iter = freeRanges.insert(iter, { offset, sizeInBytes });
+
+	const auto next = iter + 1;
+	if (next != freeRanges.end() && iter->offset + iter->size == next->offset)
+	{
+		iter->size += next->size;
+		freeRanges.erase(next);
+	}
+	if (iter != freeRanges.begin())
+	{
+		const auto prev = iter - 1;
+		if (prev->offset + prev->size == iter->offset)
+		{
+			prev->size += iter->size;
+			freeRanges.erase(iter);
+		}
+	}
+}
+
+void LabArchiveEditor::rebuildFreeRanges()
+{
+	std::vector<Range> usedRanges;
+	usedRanges.reserve(entries.size() + pinnedRanges.size() + 1);
+	usedRanges.push_back({ 0, metadataCapacity });
+	usedRanges.insert(usedRanges.end(), pinnedRanges.begin(), pinnedRanges.end());
+
+	for (const auto & entry : entries)
+	{
+		if (entry.sizeInBytes != 0)
+		{
+			usedRanges.push_back({ entry.dataOffset, entry.sizeInBytes });
+		}
+	}
+
+	std::sort(std::begin(usedRanges), std::end(usedRanges),
+		[](const Range & a, const Range & b) { return a.offset < b.offset; });
+
+	// Entries may overlap or share data, so track the furthest end seen so far.
+	freeRanges.clear();
+	std::uint64_t usedEnd = 0;
+	for (const auto & range : usedRanges)
+	{
+		if (range.offset > usedEnd)
+		{
+			freeRanges.push_back({ usedEnd, range.offset - usedEnd });
+		}
+		usedEnd = std::max(usedEnd, range.offset + range.size);
+	}
+
+	if (usedEnd < fileSize)
+	{
+		freeRanges.push_back({ usedEnd, fileSize - usedEnd });
+	}
+}
+
+std::uint64_t LabArchiveEditor::computeMetadataSize() const
+{
+	std::uint64_t metadataSize = sizeof(LabHeader) + (entries.size() * sizeof(LabFileEntry));
+	for (const auto & entry : entries)
+	{
+		metadataSize += entry.name.length() + 1; // Including the null byte.
+	}
+	return metadataSize;
+}
+
+std::vector<std::uint8_t> LabArchiveEditor::buildMetadata(const std::vector<Entry> & tableEntries) const
+{
+	std::uint32_t fileNameListLength = 0;
+	for (const auto & entry : tableEntries)
+	{
+		fileNameListLength += static_cast<std::uint32_t>(entry.name.length() + 1);
+	}
+
+	std::vector<std::uint8_t> metadata(sizeof(LabHeader) + (tableEntries.size() * sizeof(LabFileEntry)) + fileNameListLength);
+
+	LabHeader labHeader;
+	labHeader.id[0]              = 'L';
+	labHeader.id[1]              = 'A';
+	labHeader.id[2]              = 'B';
+	labHeader.id[3]              = 'N';
+	labHeader.unknown            = labHeaderUnknown;
+	labHeader.fileCount          = static_cast<std::uint32_t>(tableEntries.size());
+	labHeader.fileNameListLength = fileNameListLength;
+	std::memcpy(metadata.data(), &labHeader, sizeof(labHeader));
+
+	auto * labEntryPtr = metadata.data() + sizeof(LabHeader);
+	auto * namePtr     = reinterpret_cast<char *>(labEntryPtr + (tableEntries.size() * sizeof(LabFileEntry)));
+	std::uint32_t nameOffset = 0;
+
+	for (const auto & entry : tableEntries)
+	{
+		LabFileEntry labEntry;
+		labEntry.nameOffset  = nameOffset;
+		labEntry.dataOffset  = entry.dataOffset;
+		labEntry.sizeInBytes = entry.sizeInBytes;
+		std::memcpy(labEntry.typeId, entry.typeId, sizeof(labEntry.typeId));
+		std::memcpy(labEntryPtr, &labEntry, sizeof(labEntry));
+		labEntryPtr += sizeof(labEntry);
+
+		// Null terminated; the vector is zero filled.
+		std::memcpy(namePtr + nameOffset, entry.name.data(), entry.name.length());
+		nameOffset += static_cast<std::uint32_t>(entry.name.length() + 1);
+	}
+
+	return metadata;
+}
+
+bool LabArchiveEditor::relocateEntriesBelow(const std::uint64_t newCapacity)
+{
+	//
+	// The metadata grows into the start of the data section. Anything
+	// living there is copied out first; the old copies are overwritten
+	// by the new table only after that, when commit() writes it.
+	//
+
+	if (fileSize < newCapacity)
+	{
+		if (!filesys::preallocateFile(labFile, newCapacity))
+		{
+			std::cerr << "Failed to grow LAB archive " << labFileName << "!\n";
+			return false;
+		}
+		fileSize = newCapacity;
+	}
+
+	// The new metadata area is no longer available for allocation.
+	std::vector<Range> remainingFree;
+	for (const auto & range : freeRanges)
+	{
+		const std::uint64_t rangeEnd = range.offset + range.size;
+		if (rangeEnd <= newCapacity)
+		{
+			continue;
+		}
+		const std::uint64_t start = std::max(range.offset, newCapacity);
+		remainingFree.push_back({ start, rangeEnd - start });
+	}
+	freeRanges = std::move(remainingFree);
+
+	// Entries that shared data before still share it after the move.
+	std::unordered_map<std::uint64_t, std::uint32_t> movedOffsets;
+
+	for (auto & entry : entries)
+	{
+		if (entry.sizeInBytes == 0 || entry.dataOffset >= newCapacity)
+		{
+			continue;
+		}
+
+		const std::uint64_t key = (std::uint64_t(entry.dataOffset) << 32) | entry.sizeInBytes;
+		auto iter = movedOffsets.find(key);
+		if (iter != movedOffsets.end())
+		{
+			entry.dataOffset = iter->second;
+			continue;
+		}
+
+		std::uint64_t newOffset = 0;
+		if (!allocateSpace(entry.sizeInBytes, newOffset) ||
+		    !filesys::copyFileRangeAt(labFile, entry.dataOffset, labFile, newOffset, entry.sizeInBytes))
+		{
+			std::cerr << "Failed to move data of entry \'" << entry.name << "\'! " << labFileName << ".\n";
+			return false;
+		}
+
+		movedOffsets.emplace(key, static_cast<std::uint32_t>(newOffset));
+		entry.dataOffset = static_cast<std::uint32_t>(newOffset);
+	}
+
+	metadataCapacity = newCapacity;
+	return true;
+}
+
+} // namespace ol {}
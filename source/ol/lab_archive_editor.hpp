@@ -0,0 +1,154 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_archive_editor.hpp
+// Created on: 16/10/26
+// Brief: Incremental add/replace/remove of entries in an existing LucasArts LAB archive.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#ifndef OL_LAB_ARCHIVE_EDITOR_HPP
+#define OL_LAB_ARCHIVE_EDITOR_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "lab_name_index.hpp"
+
+namespace ol
+{
+
+// ========================================================
+// class LabArchiveEditor:
+// ========================================================
+
+//
+// Edits a LAB in place, so that changing a few entries of a big archive
+// costs I/O proportional to the change. New entry data goes into free
+// gaps left by earlier edits or is appended at the end of the file.
+// commit() then rewrites only the header, entry table and name list,
+// first moving any entry data that the grown table would overwrite.
+//
+// Space freed by removing or replacing entries is only reused after
+// the next commit(), so the table on disk never points at overwritten
+// data. An interrupted commit() can still leave a broken table, though;
+// compact() is the safe path, writing a fresh archive to a temporary
+// file that is then renamed over the original. It also drops all dead
+// space, which plain commits never give back to the file system.
+//
+class LabArchiveEditor final
+{
+public:
+
+	// Disable copy and assignment.
+	LabArchiveEditor(const LabArchiveEditor &) = delete;
+	LabArchiveEditor & operator = (const LabArchiveEditor &) = delete;
+
+	// Construct with the name of an existing LAB archive
+	// that will be opened for editing by open().
+	explicit LabArchiveEditor(std::string filename);
+
+	// Open the archive and load its entry table. Returns false
+	// and logs to STDERR if the file can't be opened or isn't a LAB.
+	bool open();
+
+	// Close the archive. Uncommitted changes are discarded;
+	// data already written for them becomes dead space.
+	void close();
+
+	bool isOpen() const { return labFile != nullptr; }
+	bool hasUncommittedChanges() const { return modified; }
+	const std::string & getFileName() const { return labFileName; }
+
+	// Entry queries, by name. Lookups are case-insensitive.
+	std::size_t getEntryCount() const { return entries.size(); }
+	bool hasEntry(const std::string & entryName) const;
+
+	// Add a new entry, failing if one with the same name exists.
+	bool addEntry(const std::string & entryName, const void * data, std::size_t sizeInBytes);
+	bool addEntryFromFile(const std::string & entryName, const std::string & sourceFile);
+
+	// Replace the data of an existing entry, failing if there is no such entry.
+	bool replaceEntry(const std::string & entryName, const void * data, std::size_t sizeInBytes);
+	bool replaceEntryFromFile(const std::string & entryName, const std::string & sourceFile);
+
+	// Remove an entry. Its data is left in place as dead space until compact().
+	bool removeEntry(const std::string & entryName);
+
+	// Write the updated header, entry table and name list. No-op if nothing changed.
+	bool commit();
+
+	// Rewrite the archive without dead space, committing any pending changes.
+	bool compact();
+
+	// Bytes in the file not used by the metadata or any entry, as of the last commit.
+	std::uint64_t getDeadSpace() const;
+	std::uint64_t getFileSize() const { return fileSize; }
+
+	// Closes the archive without committing.
+	~LabArchiveEditor();
+
+private:
+
+	struct Entry
+	{
+		std::string   name;
+		std::uint32_t dataOffset;
+		std::uint32_t sizeInBytes;
+		std::uint8_t  typeId[4];
+	};
+
+	struct Range
+	{
+		std::uint64_t offset;
+		std::uint64_t size;
+	};
+
+	// Index of the named entry or entries.size() if not found.
+	std::size_t findEntryIndex(const std::string & entryName) const;
+	void rebuildNameIndex() const;
+
+	// Adds or replaces an entry, with its data coming from memory or from a file.
+	bool putEntry(const std::string & entryName, bool mustExist, const void * data,
+	              std::size_t sizeInBytes, const std::string * sourceFile);
+
+	// Find room for sizeInBytes of new data: first free gap that fits, else the end of the file.
+	bool allocateSpace(std::uint64_t sizeInBytes, std::uint64_t & offset);
+
+	// Give back a range from allocateSpace() that ended up unused.
+	void releaseSpace(std::uint64_t offset, std::uint64_t sizeInBytes);
+
+	// Free gaps from the current entries, everything past metadataCapacity not used by an entry
+	// or a pinned range.
+	void rebuildFreeRanges();
+
+	// Header, entry table and name list for the given entries, ready to write at offset zero.
+	std::vector<std::uint8_t> buildMetadata(const std::vector<Entry> & tableEntries) const;
+	std::uint64_t computeMetadataSize() const;
+
+	// Move the data of entries below newCapacity elsewhere, so the metadata can grow over it.
+	bool relocateEntriesBelow(std::uint64_t newCapacity);
+
+	FILE *                labFile;
+	std::string           labFileName;
+	std::uint32_t         labHeaderUnknown;   // Kept as found in the original header.
+	std::uint64_t         fileSize;
+	std::uint64_t         metadataCapacity;   // Bytes at the start of the file reserved for the metadata.
+	std::vector<Entry>    entries;
+	std::vector<Range>    freeRanges;         // Sorted by offset.
+	std::vector<Range>    pinnedRanges;       // Data of entries the reader rejected, in use until the next commit.
+	bool                  modified;
+
+	// Keys point into entries[i].name, so it's rebuilt when those move.
+	mutable LabNameIndex  nameIndex;
+	mutable bool          nameIndexDirty;
+};
+
+} // namespace ol {}
+
+#endif // OL_LAB_ARCHIVE_EDITOR_HPP
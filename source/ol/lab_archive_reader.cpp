@@ -14,23 +14,152 @@
 #include "lab_archive_reader.hpp"
 #include "lab_common.hpp"
 #include "filesys_utils.hpp"
+#include "crc32c.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstring>
 #include <iomanip>
 #include <memory>
+#include <mutex>
 #include <utility>
 
 namespace ol
 {
 
+// Turns an entry name into a path relative to the extraction directory,
+// with DOS separators replaced by '/'. Fails for names that would land
+// outside of it, such as absolute paths or ones with ".." components.
+static bool makeOutputPath(const char * entryName, std::string & outputPath)
+{
+	outputPath = entryName;
+	std::replace(std::begin(outputPath), std::end(outputPath), '\\', '/');
+
+	if (outputPath.empty() || outputPath.front() == '/' || outputPath.back() == '/' ||
+	    outputPath.find(':') != std::string::npos)
+	{
+		return false;
+	}
+
+	std::size_t start = 0;
+	for (;;)
+	{
+		const auto end = outputPath.find('/', start);
+		if (outputPath.compare(start, end - start, "..") == 0)
+		{
+			return false;
+		}
+		if (end == std::string::npos)
+		{
+			return true;
+		}
+		start = end + 1;
+	}
+}
+
+// Creates the extraction directory if needed and opens it. Errors logged to STDERR.
+static bool openOutputDirectory(const std::string & destPath, filesys::DirectoryHandle & destDir)
+{
+	// Crate the path is necessary.
+	if (!destPath.empty())
+	{
+		filesys::createPath(destPath);
+	}
+
+	if (!filesys::openDirectory(destPath.empty() ? "." : destPath, destDir))
+	{
+		std::cerr << "Can't open extraction path \'" << destPath << "\'!\n";
+		return false;
+	}
+	return true;
+}
+
+// Entry names can contain directories. Finds the distinct set of them
+// and creates each one just once. Empty output paths are skipped.
+static void createOutputSubDirs(const filesys::DirectoryHandle & destDir, const std::vector<std::string> & outputPaths)
+{
+	std::vector<std::string> subDirs;
+	for (const auto & outputPath : outputPaths)
+	{
+		const auto lastSep = outputPath.find_last_of('/');
+		if (lastSep != std::string::npos)
+		{
+			subDirs.emplace_back(outputPath, 0, lastSep);
+		}
+	}
+
+	if (subDirs.empty())
+	{
+		return;
+	}
+
+	// Add the parents of each directory, then sort so that a
+	// parent always comes before its children ("a" < "a/b").
+	std::sort(std::begin(subDirs), std::end(subDirs));
+	subDirs.erase(std::unique(std::begin(subDirs), std::end(subDirs)), std::end(subDirs));
+
+	const auto leafDirCount = subDirs.size();
+	for (std::size_t d = 0; d < leafDirCount; ++d)
+	{
+		for (auto sep = subDirs[d].find('/'); sep != std::string::npos; sep = subDirs[d].find('/', sep + 1))
+		{
+			subDirs.emplace_back(subDirs[d], 0, sep);
+		}
+	}
+
+	std::sort(std::begin(subDirs), std::end(subDirs));
+	subDirs.erase(std::unique(std::begin(subDirs), std::end(subDirs)), std::end(subDirs));
+
+	for (const auto & subDir : subDirs)
+	{
+		if (!filesys::createDirectoryAt(destDir, subDir))
+		{
+			std::cerr << "Failed to create directory \'" << destDir.path << subDir << "\'!\n";
+		}
+	}
+}
+
+// Reads count items from a stream of unknown size. The buffer only grows as
+// data actually arrives, so a corrupted count can't allocate gigabytes up front.
+template<class T>
+static bool readStreamArray(FILE * stream, const std::size_t count, std::vector<T> & items)
+{
+	const std::size_t chunkItems = (256 * 1024) / sizeof(T);
+
+	items.clear();
+	while (items.size() < count)
+	{
+		const std::size_t done  = items.size();
+		const std::size_t chunk = std::min(count - done, chunkItems);
+
+		items.resize(done + chunk);
+		if (std::fread(items.data() + done, sizeof(T), chunk, stream) != chunk)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 // ========================================================
 // class LabArchiveReader:
 // ========================================================
 
-LabArchiveReader::LabArchiveReader(std::string filename)
-	: labFileHandle { nullptr }
-	, labFileName   { std::move(filename) }
+constexpr std::size_t LabArchiveReader::EntryNotFound;
+
+LabArchiveReader::LabArchiveReader(std::string filename, const OpenMode mode)
+	: labFileHandle      { nullptr }
+	, labMetadataPtr     { nullptr }
+	, labDataPtr         { nullptr }
+	, labDataSize        { 0 }
+	, labIsMapped        { false }
+	, labOpenMode        { mode }
+	, labFileContents    { }
+	, labFileEntries     { }
+	, labRejectedEntries { 0 }
+	, labFileName        { std::move(filename) }
+	, accessTracing      { false }
 { }
 
 LabArchiveReader::~LabArchiveReader()
@@ -87,17 +216,48 @@ bool LabArchiveReader::open()
 		return false;
 	}
 
-	// Rewind back the 4CC previously read:
-	std::rewind(labFileHandle);
+	if (labOpenMode == OpenMode::MemoryMapped)
+	{
+		// Map the file instead of copying it. Only the pages
+		// touched while parsing the metadata are actually read.
+		labDataPtr = filesys::mapFile(labFileHandle, fileSizeBytes);
+		if (labDataPtr == nullptr)
+		{
+			close();
+			std::cerr << "Unable to memory map LAB archive! " << labFileName << ".\n";
+			return false;
+		}
+		labIsMapped = true;
+	}
+	else if (labOpenMode == OpenMode::MetadataOnly)
+	{
+		if (!readMetadataOnly(fileSizeBytes))
+		{
+			close();
+			return false;
+		}
+	}
+	else
+	{
+		// Rewind back the 4CC previously read:
+		std::rewind(labFileHandle);
+
+		// Read the whole file into memory:
+		labFileContents.resize(fileSizeBytes);
+		if (std::fread(labFileContents.data(), sizeof(std::uint8_t),
+		    fileSizeBytes, labFileHandle) != fileSizeBytes)
+		{
+			close();
+			std::cerr << "Unable to read whole LAB archive into main memory! " << labFileName << ".\n";
+			return false;
+		}
+		labDataPtr = labFileContents.data();
+	}
+	labDataSize = fileSizeBytes;
 
-	// Read the whole file into memory:
-	labFileContents.resize(fileSizeBytes);
-	if (std::fread(labFileContents.data(), sizeof(std::uint8_t),
-	    fileSizeBytes, labFileHandle) != fileSizeBytes)
+	if (labDataPtr != nullptr)
 	{
-		close();
-		std::cerr << "Unable to read whole LAB archive into main memory! " << labFileName << ".\n";
-		return false;
+		labMetadataPtr = labDataPtr;
 	}
 
 	// Build the file table, etc.
@@ -110,6 +270,28 @@ bool LabArchiveReader::open()
 	return true;
 }
 
+bool LabArchiveReader::open(const OpenMode mode)
+{
+	if (isOpen())
+	{
+		std::cerr << "LAB archive already open!\n";
+		return false;
+	}
+
+	labOpenMode = mode;
+	return open();
+}
+
+LabArchiveReader::OpenMode LabArchiveReader::getOpenMode() const
+{
+	return labOpenMode;
+}
+
+const std::string & LabArchiveReader::getFileName() const
+{
+	return labFileName;
+}
+
 void LabArchiveReader::close()
 {
 	if (labFileHandle != nullptr)
@@ -118,13 +300,244 @@ void LabArchiveReader::close()
 		labFileHandle = nullptr;
 	}
 
-	labFileContents.clear();
+	if (labIsMapped)
+	{
+		filesys::unmapFile(labDataPtr, labDataSize);
+		labIsMapped = false;
+	}
+
+	labMetadataPtr = nullptr;
+	labDataPtr     = nullptr;
+	labDataSize    = 0;
+
+	// clear() alone would keep the buffer allocated.
+	ByteVector().swap(labFileContents);
 	labFileEntries.clear();
+	labRejectedEntries = 0;
+
+	std::lock_guard<std::mutex> lock{ traceMutex };
+	traceSeen.clear();
+	traceNames.clear();
 }
 
 bool LabArchiveReader::isOpen() const
 {
-	return (labFileHandle != nullptr) && !labFileContents.empty();
+	return (labFileHandle != nullptr) && (labMetadataPtr != nullptr);
+}
+
+std::size_t LabArchiveReader::getEntryCount() const
+{
+	return labFileEntries.size();
+}
+
+std::size_t LabArchiveReader::findEntry(const std::string & entryName) const
+{
+	return findEntry(entryName.data(), entryName.length());
+}
+
+std::size_t LabArchiveReader::findEntry(const char * entryName, const std::size_t length) const
+{
+	const auto index = labFileEntries.nameIndex.find(entryName, length);
+	return (index != LabNameIndex::NotFound) ? index : EntryNotFound;
+}
+
+const char * LabArchiveReader::getEntryName(const std::size_t index) const
+{
+	assert(index < labFileEntries.size());
+	return labFileEntries.names[index];
+}
+
+std::size_t LabArchiveReader::getEntrySize(const std::size_t index) const
+{
+	assert(index < labFileEntries.size());
+	return labFileEntries.dataSizes[index];
+}
+
+std::uint32_t LabArchiveReader::getEntryDataOffset(const std::size_t index) const
+{
+	assert(index < labFileEntries.size());
+	return labFileEntries.dataOffsets[index];
+}
+
+const char * LabArchiveReader::getEntryTypeId(const std::size_t index) const
+{
+	assert(index < labFileEntries.size());
+	return &labFileEntries.typeIds[index * 4];
+}
+
+const std::uint8_t * LabArchiveReader::getEntryData(const std::size_t index) const
+{
+	assert(index < labFileEntries.size());
+	if (labDataPtr == nullptr)
+	{
+		return nullptr;
+	}
+	if (accessTracing)
+	{
+		traceAccess(index);
+	}
+	return labDataPtr + labFileEntries.dataOffsets[index];
+}
+
+bool LabArchiveReader::readEntry(const std::size_t index, void * destBuffer, const std::size_t bufferSizeBytes) const
+{
+	assert(index < labFileEntries.size());
+	assert(destBuffer != nullptr);
+
+	const auto dataOffset = labFileEntries.dataOffsets[index];
+	const auto dataSize   = labFileEntries.dataSizes[index];
+
+	if (bufferSizeBytes < dataSize)
+	{
+		std::cerr << "Buffer too small for LAB entry \'" << labFileEntries.names[index] << "\'!\n";
+		return false;
+	}
+
+	if (accessTracing)
+	{
+		traceAccess(index);
+	}
+
+	if (labDataPtr != nullptr)
+	{
+		std::memcpy(destBuffer, labDataPtr + dataOffset, dataSize);
+		return true;
+	}
+
+	if (!filesys::readFileAt(labFileHandle, dataOffset, destBuffer, dataSize))
+	{
+		std::cerr << "Failed to read LAB entry \'" << labFileEntries.names[index] << "\'! " << labFileName << ".\n";
+		return false;
+	}
+	return true;
+}
+
+std::future<int> LabArchiveReader::readEntriesAsync(std::vector<ReadRequest> requests,
+                                                    ReadCallback onComplete,
+                                                    const int numThreads) const
+{
+	// readEntry() only does positioned reads or memcpys, so
+	// concurrent calls on the same reader are safe.
+	const auto readBatch = [this, numThreads](const std::vector<ReadRequest> & batch, const ReadCallback & callback)
+	{
+		std::atomic<int> readsDone{ 0 };
+
+		parallelFor(batch.size(), numThreads, [&](const std::size_t r)
+		{
+			const auto & request = batch[r];
+			const auto index = (request.entryIndex != EntryNotFound) ? request.entryIndex : findEntry(request.entryName);
+
+			bool success = false;
+			if (index < getEntryCount())
+			{
+				success = readEntry(index, request.destBuffer, request.bufferSizeBytes);
+			}
+			else if (request.entryIndex != EntryNotFound)
+			{
+				std::cerr << "LAB entry index " << request.entryIndex << " is out of range! " << labFileName << ".\n";
+			}
+			else
+			{
+				std::cerr << "LAB entry \'" << request.entryName << "\' not found! " << labFileName << ".\n";
+			}
+
+			if (success)
+			{
+				++readsDone;
+			}
+			if (callback)
+			{
+				callback(r, success);
+			}
+		});
+
+		return static_cast<int>(readsDone);
+	};
+
+	return std::async(std::launch::async, readBatch, std::move(requests), std::move(onComplete));
+}
+
+bool LabArchiveReader::computeEntryChecksums(std::vector<std::uint32_t> & checksums, const int numThreads) const
+{
+	checksums.assign(labFileEntries.size(), 0);
+	std::atomic<bool> allRead{ true };
+
+	parallelFor(labFileEntries.size(), numThreads, [&](const std::size_t i)
+	{
+		if (labDataPtr != nullptr)
+		{
+			checksums[i] = crc32c(labDataPtr + labFileEntries.dataOffsets[i], labFileEntries.dataSizes[i]);
+			return;
+		}
+
+		// Not resident, go through a small buffer.
+		std::uint8_t buffer[64 * 1024];
+		std::uint64_t offset = labFileEntries.dataOffsets[i];
+		std::size_t bytesLeft = labFileEntries.dataSizes[i];
+		std::uint32_t crc = 0;
+
+		while (bytesLeft > 0)
+		{
+			const std::size_t chunk = std::min(bytesLeft, sizeof(buffer));
+			if (!filesys::readFileAt(labFileHandle, offset, buffer, chunk))
+			{
+				std::cerr << "Failed to read LAB entry \'" << labFileEntries.names[i] << "\'! " << labFileName << ".\n";
+				allRead = false;
+				return;
+			}
+			crc = crc32c(buffer, chunk, crc);
+			offset    += chunk;
+			bytesLeft -= chunk;
+		}
+		checksums[i] = crc;
+	});
+
+	return allRead;
+}
+
+bool LabArchiveReader::hasEntry(const std::string & entryName) const
+{
+	return findEntry(entryName) != EntryNotFound;
+}
+
+bool LabArchiveReader::getEntrySize(const std::string & entryName, std::size_t & sizeInBytes) const
+{
+	const auto index = findEntry(entryName);
+	if (index == EntryNotFound)
+	{
+		sizeInBytes = 0;
+		return false;
+	}
+
+	sizeInBytes = getEntrySize(index);
+	return true;
+}
+
+const std::uint8_t * LabArchiveReader::getEntryData(const std::string & entryName, std::size_t * sizeInBytes) const
+{
+	const auto index = findEntry(entryName);
+	if (index == EntryNotFound || labDataPtr == nullptr)
+	{
+		if (sizeInBytes != nullptr) { *sizeInBytes = 0; }
+		return nullptr;
+	}
+
+	if (sizeInBytes != nullptr)
+	{
+		*sizeInBytes = getEntrySize(index);
+	}
+	return getEntryData(index);
+}
+
+bool LabArchiveReader::readEntry(const std::string & entryName, void * destBuffer, const std::size_t bufferSizeBytes) const
+{
+	const auto index = findEntry(entryName);
+	if (index == EntryNotFound)
+	{
+		std::cerr << "LAB entry \'" << entryName << "\' not found! " << labFileName << ".\n";
+		return false;
+	}
+	return readEntry(index, destBuffer, bufferSizeBytes);
 }
 
 void LabArchiveReader::listFileEntries(std::ostream & os) const
@@ -139,86 +552,373 @@ void LabArchiveReader::listFileEntries(std::ostream & os) const
 		os << "+-------------+-------------+--------------------+\n";
 		os << "| dataOffset  |  sizeBytes  |  id/filename       |\n";
 		os << "+-------------+-------------+--------------------+\n";
-		for (const auto & entry : labFileEntries)
+		for (std::size_t i = 0; i < labFileEntries.size(); ++i)
 		{
+			const char * typeId = getEntryTypeId(i);
 			const char idString[] =
 			{
-				entry.second.typeId[0] ? entry.second.typeId[0] : '-',
-				entry.second.typeId[1] ? entry.second.typeId[1] : '-',
-				entry.second.typeId[2] ? entry.second.typeId[2] : '-',
-				entry.second.typeId[3] ? entry.second.typeId[3] : '-',
+				typeId[0] ? typeId[0] : '-',
+				typeId[1] ? typeId[1] : '-',
+				typeId[2] ? typeId[2] : '-',
+				typeId[3] ? typeId[3] : '-',
 				'\0'
 			};
-			os << "  "  << std::setw(11) << std::left << entry.second.dataOffset
-			   << " | " << std::setw(11) << std::left << entry.second.dataSizeBytes
-			   << " | " << "[" << idString << "] " << entry.first << "\n";
+			os << "  "  << std::setw(11) << std::left << labFileEntries.dataOffsets[i]
+			   << " | " << std::setw(11) << std::left << labFileEntries.dataSizes[i]
+			   << " | " << "[" << idString << "] " << labFileEntries.names[i] << "\n";
 		}
 	}
 	os << "[[ listed " << labFileEntries.size() << " entries ]]\n";
 }
 
-int LabArchiveReader::extractWholeArchive(const std::string & destPath) const
+int LabArchiveReader::extractWholeArchive(const std::string & destPath, const int numThreads) const
 {
-	if (!isOpen())
+	std::vector<std::size_t> indexes(labFileEntries.size());
+	for (std::size_t i = 0; i < indexes.size(); ++i)
 	{
-		std::cerr << "LAB archive not open!\n";
-		return 0;
+		indexes[i] = i;
 	}
+	return extractEntries(destPath, indexes, numThreads);
+}
 
-	// Crate the path is necessary.
-	if (!destPath.empty())
+int LabArchiveReader::extractFromStream(FILE * stream, const std::string & streamName,
+                                        const std::string & destPath, const EntryFilter & filter)
+{
+	assert(stream != nullptr);
+
+	LabHeader labHeader;
+	if (std::fread(&labHeader, sizeof(labHeader), 1, stream) != 1)
 	{
-		filesys::createPath(destPath);
+		std::cerr << "Can't read LAB header! " << streamName << ".\n";
+		return -1;
 	}
 
-	// Data offsets for each entry are absolute from the beginning of the file.
-	const auto * labDataPtr = labFileContents.data();
+	if (labHeader.id[0] != 'L' ||
+	    labHeader.id[1] != 'A' ||
+	    labHeader.id[2] != 'B' ||
+	    labHeader.id[3] != 'N')
+	{
+		std::cerr << "Bad LAB id! " << streamName << ".\n";
+		return -1;
+	}
+
+	const auto fileCount = labHeader.fileCount;
+	const auto fileNameListLength = labHeader.fileNameListLength;
+
+	// No file size to check against, but all offsets in a LAB are 32-bits.
+	const std::uint64_t metadataSize = sizeof(LabHeader) +
+		(static_cast<std::uint64_t>(fileCount) * sizeof(LabFileEntry)) + fileNameListLength;
+	if (metadataSize > UINT32_MAX)
+	{
+		std::cerr << "LAB entry table exceeds the 4GB limit of the format! " << streamName << ".\n";
+		return -1;
+	}
+
+	std::vector<LabFileEntry> labEntries;
+	std::vector<char> fileNameList;
+
+	if (!readStreamArray(stream, fileCount, labEntries) ||
+	    !readStreamArray(stream, fileNameListLength, fileNameList))
+	{
+		std::cerr << "Can't read LAB entry table! " << streamName << ".\n";
+		return -1;
+	}
+
+	// Everything from here on is entry data.
+	std::uint64_t streamPos = sizeof(LabHeader) +
+		(static_cast<std::uint64_t>(fileCount) * sizeof(LabFileEntry)) + fileNameListLength;
+
+	struct StreamEntry
+	{
+		std::uint64_t start;
+		std::uint64_t end;
+		std::string   outputPath;
+		FILE *        fileOut;
+	};
+
+	std::vector<StreamEntry> selected;
+	for (const auto & entry : labEntries)
+	{
+		const char * nameListEnd = fileNameList.data() + fileNameListLength;
+		const char * namePtr = fileNameList.data() + entry.nameOffset;
+		if (entry.nameOffset >= fileNameListLength || std::find(namePtr, nameListEnd, '\0') == nameListEnd)
+		{
+			std::cerr << "Warning: LAB entry with bad name offset! Ignoring it... " << streamName << ".\n";
+			continue;
+		}
+		if (entry.dataOffset < streamPos)
+		{
+			std::cerr << "Warning: LAB entry with bad data offset! Ignoring it... " << streamName << ".\n";
+			continue;
+		}
+		if (!filter.matches(namePtr, reinterpret_cast<const char *>(entry.typeId)))
+		{
+			continue;
+		}
+
+		StreamEntry streamEntry{ entry.dataOffset, static_cast<std::uint64_t>(entry.dataOffset) + entry.sizeInBytes, "", nullptr };
+		if (!makeOutputPath(namePtr, streamEntry.outputPath))
+		{
+			std::cerr << "Unsafe LAB entry name \'" << namePtr << "\'! Won't be extracted...\n";
+			continue;
+		}
+		selected.push_back(std::move(streamEntry));
+	}
+
+	// Stream order. Entries sharing the same data (or overlapping) are
+	// all open at the same time and get the bytes as they go past.
+	std::sort(std::begin(selected), std::end(selected),
+		[](const StreamEntry & a, const StreamEntry & b) { return a.start < b.start; });
+
+	filesys::DirectoryHandle destDir;
+	if (!openOutputDirectory(destPath, destDir))
+	{
+		return -1;
+	}
+
+	std::vector<std::string> outputPaths;
+	outputPaths.reserve(selected.size());
+	for (const auto & streamEntry : selected)
+	{
+		outputPaths.push_back(streamEntry.outputPath);
+	}
+	createOutputSubDirs(destDir, outputPaths);
 
 	int filesWritten = 0;
-	std::string fullPathName;
+	std::size_t nextEntry = 0;
+	std::vector<StreamEntry *> activeEntries;
+	std::vector<std::uint8_t> buffer(256 * 1024);
+	bool endOfStream = false;
 
-	// Write 'em:
-	for (const auto & entry : labFileEntries)
+	while (!endOfStream)
 	{
-		if (destPath.back() != *filesys::getPathSeparator())
+		// Start every entry whose data begins here.
+		while (nextEntry < selected.size() && selected[nextEntry].start == streamPos)
+		{
+			StreamEntry & streamEntry = selected[nextEntry++];
+			streamEntry.fileOut = filesys::openFileForWritingAt(destDir, streamEntry.outputPath);
+			if (streamEntry.fileOut == nullptr)
+			{
+				std::cerr << "Failed to open file \'" << destDir.path << streamEntry.outputPath << "\' for writing!\n";
+				continue;
+			}
+			activeEntries.push_back(&streamEntry);
+		}
+
+		// Finish the ones that are done, including empty files.
+		for (auto iter = activeEntries.begin(); iter != activeEntries.end();)
 		{
-			fullPathName = destPath + filesys::getPathSeparator() + entry.first;
+			if ((*iter)->end == streamPos)
+			{
+				std::fclose((*iter)->fileOut);
+				++filesWritten;
+				iter = activeEntries.erase(iter);
+			}
+			else
+			{
+				++iter;
+			}
 		}
-		else
+
+		if (nextEntry == selected.size() && activeEntries.empty())
 		{
-			fullPathName = destPath + entry.first;
+			break; // Don't care about the rest of the stream.
 		}
 
-		FILE * fileOut = std::fopen(fullPathName.c_str(), "wb");
-		if (fileOut == nullptr)
+		// Read up to the next place where an entry starts or ends.
+		std::uint64_t chunkEnd = streamPos + buffer.size();
+		if (nextEntry < selected.size())
+		{
+			chunkEnd = std::min(chunkEnd, selected[nextEntry].start);
+		}
+		for (const auto * active : activeEntries)
+		{
+			chunkEnd = std::min(chunkEnd, active->end);
+		}
+		if (chunkEnd == streamPos)
 		{
-			std::cerr << "Failed to open file \'" << fullPathName.c_str() << "\' for writing!\n";
 			continue;
 		}
 
-		const auto * myData = labDataPtr + entry.second.dataOffset;
-		const auto   mySize = entry.second.dataSizeBytes;
+		const auto chunkSize = static_cast<std::size_t>(chunkEnd - streamPos);
+		if (std::fread(buffer.data(), sizeof(std::uint8_t), chunkSize, stream) != chunkSize)
+		{
+			endOfStream = true;
+			break;
+		}
+
+		// Gaps between entries are just dropped.
+		for (const auto * active : activeEntries)
+		{
+			if (std::fwrite(buffer.data(), sizeof(std::uint8_t), chunkSize, active->fileOut) != chunkSize)
+			{
+				std::cerr << "Failed to write entry data for \'" << destDir.path << active->outputPath << "\'!\n";
+			}
+		}
+		streamPos = chunkEnd;
+	}
+
+	if (endOfStream)
+	{
+		std::cerr << "Unexpected end of LAB stream! " << streamName << ".\n";
+		for (const auto * active : activeEntries)
+		{
+			std::cerr << "Entry \'" << destDir.path << active->outputPath << "\' is truncated!\n";
+			std::fclose(active->fileOut);
+		}
+		filesys::closeDirectory(destDir);
+		return -1;
+	}
+
+	filesys::closeDirectory(destDir);
+	return filesWritten;
+}
+
+std::vector<std::size_t> LabArchiveReader::findEntries(const EntryFilter & filter) const
+{
+	std::vector<std::size_t> indexes;
+	for (std::size_t i = 0; i < labFileEntries.size(); ++i)
+	{
+		if (filter.matches(labFileEntries.names[i], getEntryTypeId(i)))
+		{
+			indexes.push_back(i);
+		}
+	}
+	return indexes;
+}
+
+int LabArchiveReader::extractEntries(const std::string & destPath, const EntryFilter & filter, const int numThreads) const
+{
+	return extractEntries(destPath, findEntries(filter), numThreads);
+}
+
+int LabArchiveReader::extractEntries(const std::string & destPath, const std::vector<std::size_t> & indexes, const int numThreads) const
+{
+	if (!isOpen())
+	{
+		std::cerr << "LAB archive not open!\n";
+		return 0;
+	}
+
+	// Everything below is opened relative to this, so the
+	// destination path is only resolved once by the OS.
+	filesys::DirectoryHandle destDir;
+	if (!openOutputDirectory(destPath, destDir))
+	{
+		return 0;
+	}
+
+	const auto entryCount = indexes.size();
+	std::vector<std::string> outputPaths(entryCount);
+
+	for (std::size_t i = 0; i < entryCount; ++i)
+	{
+		assert(indexes[i] < labFileEntries.size());
+		if (!makeOutputPath(labFileEntries.names[indexes[i]], outputPaths[i]))
+		{
+			std::cerr << "Unsafe LAB entry name \'" << labFileEntries.names[indexes[i]] << "\'! Won't be extracted...\n";
+			outputPaths[i].clear();
+		}
+	}
+
+	createOutputSubDirs(destDir, outputPaths);
+
+	std::atomic<int> filesWritten{ 0 };
+	std::mutex logMutex;
+
+	// Write 'em. Each entry goes to its own file, so entries are independent.
+	parallelFor(entryCount, numThreads, [&](const std::size_t i)
+	{
+		if (outputPaths[i].empty())
+		{
+			return;
+		}
+
+		FILE * fileOut = filesys::openFileForWritingAt(destDir, outputPaths[i]);
+		if (fileOut == nullptr)
+		{
+			std::lock_guard<std::mutex> lock{ logMutex };
+			std::cerr << "Failed to open file \'" << destDir.path << outputPaths[i] << "\' for writing!\n";
+			return;
+		}
 
-		if (std::fwrite(myData, sizeof(*myData), mySize, fileOut) != mySize)
+		if (!writeEntryToFile(indexes[i], fileOut))
 		{
-			std::cerr << "fwrite() failed for \'" << fullPathName.c_str() << "\'!\n";
+			std::lock_guard<std::mutex> lock{ logMutex };
+			std::cerr << "Failed to write entry data for \'" << destDir.path << outputPaths[i] << "\'!\n";
 			// Count it as a success anyways...
 		}
 
 		std::fclose(fileOut);
 		++filesWritten;
-	}
+	});
 
+	filesys::closeDirectory(destDir);
 	return filesWritten;
 }
 
+bool LabArchiveReader::readMetadataOnly(const std::size_t fileSizeBytes)
+{
+	// Read the header first to find out how much more we need.
+	LabHeader labHeader;
+	if (fileSizeBytes < sizeof(labHeader) ||
+	    !filesys::readFileAt(labFileHandle, 0, &labHeader, sizeof(labHeader)))
+	{
+		std::cerr << "Can't read LAB header! " << labFileName << ".\n";
+		return false;
+	}
+
+	// Header + entry table + name list. Validated again by loadArchiveMetadata().
+	const std::uint64_t metadataSize = sizeof(LabHeader) +
+		(static_cast<std::uint64_t>(labHeader.fileCount) * sizeof(LabFileEntry)) + labHeader.fileNameListLength;
+	if (metadataSize > fileSizeBytes)
+	{
+		std::cerr << "LAB entry table exceeds the archive size! " << labFileName << ".\n";
+		return false;
+	}
+
+	labFileContents.resize(static_cast<std::size_t>(metadataSize));
+	if (!filesys::readFileAt(labFileHandle, 0, labFileContents.data(), labFileContents.size()))
+	{
+		std::cerr << "Unable to read LAB entry table! " << labFileName << ".\n";
+		return false;
+	}
+
+	labMetadataPtr = labFileContents.data();
+	return true;
+}
+
+bool LabArchiveReader::writeEntryToFile(const std::size_t index, FILE * fileOut) const
+{
+	// Data offsets for each entry are absolute from the beginning of the file.
+	const auto dataOffset = labFileEntries.dataOffsets[index];
+	const auto dataSize   = labFileEntries.dataSizes[index];
+
+	// Already paid for the copy into our own buffer, so write from it.
+	if (labOpenMode == OpenMode::LoadWholeFile)
+	{
+		const auto * myData = labDataPtr + dataOffset;
+		return std::fwrite(myData, sizeof(*myData), dataSize, fileOut) == dataSize;
+	}
+
+	// Mapped or not resident, let the kernel move the bytes from the archive file.
+	return filesys::copyFileRange(labFileHandle, dataOffset, fileOut, dataSize);
+}
+
 bool LabArchiveReader::loadArchiveMetadata()
 {
 	assert(isOpen());
 
+	const auto fileSize = labDataSize;
+	if (fileSize < sizeof(LabHeader))
+	{
+		std::cerr << "LAB archive too small for a header! " << labFileName << ".\n";
+		return false;
+	}
+
 	// Data starts with the LAB header:
 	const auto * labHeaderPtr =
-		reinterpret_cast<const LabHeader *>(labFileContents.data());
+		reinterpret_cast<const LabHeader *>(labMetadataPtr);
 
 	// Followed by a list of file entry headers:
 	const auto * labEntryPtr =
@@ -239,10 +939,22 @@ bool LabArchiveReader::loadArchiveMetadata()
 		return false;
 	}
 
-	const auto fileSize  = labFileContents.size();
 	const auto fileCount = labHeaderPtr->fileCount;
 	const auto fileNameListLength = labHeaderPtr->fileNameListLength;
 
+	// The entry table and name list must be inside the file. Reading past
+	// the end of a mapping would crash rather than return garbage.
+	const std::uint64_t metadataSize = sizeof(LabHeader) +
+		(static_cast<std::uint64_t>(fileCount) * sizeof(LabFileEntry)) + fileNameListLength;
+	if (metadataSize > fileSize)
+	{
+		std::cerr << "LAB entry table exceeds the archive size! " << labFileName << ".\n";
+		return false;
+	}
+
+	// Sized for the worst case up front, so no more allocations happen below.
+	labFileEntries.reserve(fileCount);
+
 	for (std::size_t f = 0; f < fileCount; ++f, ++labEntryPtr)
 	{
 		const auto & entry = *labEntryPtr;
@@ -253,25 +965,264 @@ bool LabArchiveReader::loadArchiveMetadata()
 			std::cerr << "Warning: LAB entry with bad name offset! Ignoring it... " << labFileName << ".\n";
 			continue;
 		}
-		if (entry.dataOffset >= fileSize)
+		if (entry.dataOffset > fileSize)
 		{
 			std::cerr << "Warning: LAB entry with bad data offset! Ignoring it... " << labFileName << ".\n";
 			continue;
 		}
-		if ((entry.dataOffset + entry.sizeInBytes) > fileSize)
+		if ((static_cast<std::uint64_t>(entry.dataOffset) + entry.sizeInBytes) > fileSize)
 		{
 			std::cerr << "Warning: LAB entry with bad data offset/size! Ignoring it... " << labFileName << ".\n";
 			continue;
 		}
 
-		// Assume each filename will be terminated by one or
-		// more null bytes. Should be true for a good file...
-		std::string entryName  { &labFileNameListPtr[entry.nameOffset] };
-		TableEntry  tableEntry { entry.dataOffset, entry.sizeInBytes, entry.typeId };
-		labFileEntries.emplace(std::move(entryName), tableEntry);
+		// Each filename should be terminated by one or more null bytes,
+		// but don't trust the last one to be, it could run off the list.
+		const char * namePtr = &labFileNameListPtr[entry.nameOffset];
+		const auto * nameEnd = std::find(namePtr, labFileNameListPtr + fileNameListLength, '\0');
+		if (nameEnd == labFileNameListPtr + fileNameListLength)
+		{
+			std::cerr << "Warning: LAB entry with unterminated name! Ignoring it... " << labFileName << ".\n";
+			continue;
+		}
+
+		// Keep the first entry if a name repeats.
+		const auto index = static_cast<std::uint32_t>(labFileEntries.size());
+		if (!labFileEntries.nameIndex.insert(namePtr, nameEnd - namePtr, index))
+		{
+			std::cerr << "Warning: Duplicate LAB entry \'" << namePtr << "\'! Ignoring it... " << labFileName << ".\n";
+			continue;
+		}
+
+		labFileEntries.dataOffsets.push_back(entry.dataOffset);
+		labFileEntries.dataSizes.push_back(entry.sizeInBytes);
+		labFileEntries.typeIds.insert(labFileEntries.typeIds.end(), entry.typeId, entry.typeId + 4);
+		labFileEntries.names.push_back(namePtr);
 	}
 
+	labRejectedEntries = fileCount - labFileEntries.size();
 	return true;
 }
 
+// ========================================================
+// LabArchiveReader::EntryMapping:
+// ========================================================
+
+LabArchiveReader::EntryMapping::EntryMapping()
+	: data        { nullptr }
+	, sizeInBytes { 0 }
+	, mappedBase  { nullptr }
+	, mappedSize  { 0 }
+{ }
+
+LabArchiveReader::EntryMapping::EntryMapping(EntryMapping && other)
+	: data        { other.data        }
+	, sizeInBytes { other.sizeInBytes }
+	, mappedBase  { other.mappedBase  }
+	, mappedSize  { other.mappedSize  }
+{
+	other.data        = nullptr;
+	other.sizeInBytes = 0;
+	other.mappedBase  = nullptr;
+	other.mappedSize  = 0;
+}
+
+LabArchiveReader::EntryMapping & LabArchiveReader::EntryMapping::operator = (EntryMapping && other)
+{
+	if (this != &other)
+	{
+		release();
+		std::swap(data,        other.data);
+		std::swap(sizeInBytes, other.sizeInBytes);
+		std::swap(mappedBase,  other.mappedBase);
+		std::swap(mappedSize,  other.mappedSize);
+	}
+	return *this;
+}
+
+LabArchiveReader::EntryMapping::~EntryMapping()
+{
+	release();
+}
+
+void LabArchiveReader::EntryMapping::release()
+{
+	filesys::unmapFile(mappedBase, mappedSize);
+	data        = nullptr;
+	sizeInBytes = 0;
+	mappedBase  = nullptr;
+	mappedSize  = 0;
+}
+
+LabArchiveReader::EntryMapping LabArchiveReader::mapEntry(const std::size_t index) const
+{
+	assert(isOpen());
+	assert(index < labFileEntries.size());
+
+	if (accessTracing)
+	{
+		traceAccess(index);
+	}
+
+	EntryMapping mapping;
+	const std::size_t dataSize = labFileEntries.dataSizes[index];
+	if (dataSize == 0)
+	{
+		return mapping;
+	}
+
+	mapping.data = filesys::mapFileRange(labFileHandle, labFileEntries.dataOffsets[index], dataSize,
+	                                     mapping.mappedBase, mapping.mappedSize);
+	if (mapping.data != nullptr)
+	{
+		mapping.sizeInBytes = dataSize;
+	}
+	return mapping;
+}
+
+void LabArchiveReader::setAccessTracing(const bool enable)
+{
+	std::lock_guard<std::mutex> lock{ traceMutex };
+	accessTracing = enable;
+
+	if (enable)
+	{
+		traceSeen.clear();
+		traceNames.clear();
+	}
+}
+
+std::vector<std::string> LabArchiveReader::getAccessTrace() const
+{
+	std::lock_guard<std::mutex> lock{ traceMutex };
+	return traceNames;
+}
+
+bool LabArchiveReader::saveAccessTrace(const std::string & filename) const
+{
+	const auto trace = getAccessTrace();
+
+	FILE * fileOut = std::fopen(filename.c_str(), "wt");
+	if (fileOut == nullptr)
+	{
+		std::cerr << "Failed to open file " << filename << " for writing!\n";
+		return false;
+	}
+
+	bool ok = true;
+	for (const auto & name : trace)
+	{
+		ok = ok && std::fprintf(fileOut, "%s\n", name.c_str()) > 0;
+	}
+
+	if (std::fclose(fileOut) != 0 || !ok)
+	{
+		std::cerr << "Failed to write access trace " << filename << "!\n";
+		return false;
+	}
+	return true;
+}
+
+void LabArchiveReader::traceAccess(const std::size_t index) const
+{
+	std::lock_guard<std::mutex> lock{ traceMutex };
+
+	// Sized on first use, the trace can be enabled before open().
+	if (traceSeen.size() != labFileEntries.size())
+	{
+		traceSeen.resize(labFileEntries.size(), 0);
+	}
+
+	if (!traceSeen[index])
+	{
+		traceSeen[index] = 1;
+		traceNames.emplace_back(labFileEntries.names[index]);
+	}
+}
+
+// ========================================================
+// LabArchiveReader::EntryFilter:
+// ========================================================
+
+bool LabArchiveReader::EntryFilter::matches(const char * entryName, const char * entryTypeId) const
+{
+	if (!namePatterns.empty())
+	{
+		const bool anyMatch = std::any_of(std::begin(namePatterns), std::end(namePatterns),
+			[entryName](const std::string & pattern) { return matchFileNamePattern(pattern.c_str(), entryName); });
+		if (!anyMatch)
+		{
+			return false;
+		}
+	}
+
+	if (!extensions.empty())
+	{
+		const char * entryExt = std::strrchr(entryName, '.');
+		entryExt = (entryExt != nullptr) ? (entryExt + 1) : "";
+
+		const bool anyMatch = std::any_of(std::begin(extensions), std::end(extensions),
+			[entryExt](const std::string & ext)
+			{
+				const char * wantedExt = (!ext.empty() && ext[0] == '.') ? (ext.c_str() + 1) : ext.c_str();
+				return lowercase(wantedExt) == lowercase(entryExt);
+			});
+		if (!anyMatch)
+		{
+			return false;
+		}
+	}
+
+	if (!typeIds.empty())
+	{
+		const bool anyMatch = std::any_of(std::begin(typeIds), std::end(typeIds),
+			[entryTypeId](const std::string & typeId)
+			{
+				if (typeId.length() != 4)
+				{
+					return false;
+				}
+				for (int c = 0; c < 4; ++c)
+				{
+					const char wanted = (typeId[c] == '-') ? '\0' : typeId[c];
+					if (std::toupper(static_cast<unsigned char>(wanted)) !=
+					    std::toupper(static_cast<unsigned char>(entryTypeId[c])))
+					{
+						return false;
+					}
+				}
+				return true;
+			});
+		if (!anyMatch)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// ========================================================
+// LabArchiveReader::FileTable:
+// ========================================================
+
+void LabArchiveReader::FileTable::reserve(const std::size_t entryCount)
+{
+	dataOffsets.reserve(entryCount);
+	dataSizes.reserve(entryCount);
+	typeIds.reserve(entryCount * 4);
+	names.reserve(entryCount);
+	nameIndex.reset(entryCount);
+}
+
+void LabArchiveReader::FileTable::clear()
+{
+	// Release the memory too, the archive could have been a big one.
+	std::vector<std::uint32_t>().swap(dataOffsets);
+	std::vector<std::uint32_t>().swap(dataSizes);
+	std::vector<char>().swap(typeIds);
+	std::vector<const char *>().swap(names);
+	nameIndex.clear();
+}
+
 } // namespace ol {}
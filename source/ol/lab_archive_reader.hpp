@@ -16,10 +16,14 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <iostream>
-#include <unordered_map>
+
+#include "lab_name_index.hpp"
 
 namespace ol
 {
@@ -32,18 +36,100 @@ class LabArchiveReader final
 {
 public:
 
+	// How the archive contents are accessed after open().
+	enum class OpenMode
+	{
+		LoadWholeFile, // Read the whole archive into a private memory buffer.
+		MemoryMapped,  // Map the archive file; pages are loaded on demand and shared.
+		MetadataOnly   // Only read the header, entry table and name list; entry data is read on demand.
+	};
+
+	// Selects entries for findEntries() and extractEntries(). An entry is selected
+	// if it matches at least one item of each non-empty list, so an empty filter
+	// selects everything. All comparisons are case-insensitive.
+	struct EntryFilter
+	{
+		std::vector<std::string> namePatterns; // Wildcard patterns, e.g. "*.pcx" or "hideout\*".
+		std::vector<std::string> extensions;   // Filename extensions, with or without the dot.
+		std::vector<std::string> typeIds;      // 4CC type ids, e.g. "MTXT". '-' matches a zero byte.
+
+		bool empty() const { return namePatterns.empty() && extensions.empty() && typeIds.empty(); }
+		bool matches(const char * entryName, const char * entryTypeId) const;
+	};
+
+	// One read of a batch given to readEntriesAsync().
+	struct ReadRequest
+	{
+		std::size_t entryIndex;      // Entry to read. If EntryNotFound, entryName is looked up instead.
+		std::string entryName;       // Only used when entryIndex is EntryNotFound.
+		void *      destBuffer;      // Receives the entry data.
+		std::size_t bufferSizeBytes; // Must be at least the size of the entry.
+	};
+
+	// Called once per request of a batch, as soon as it is done, from one of the I/O
+	// threads. requestIndex is the position of the request in the batch.
+	using ReadCallback = std::function<void(std::size_t requestIndex, bool success)>;
+
+	// Read-only mapping of the data of a single entry, straight from the
+	// archive file, returned by mapEntry(). Movable, not copyable. Unmapped
+	// when destroyed; independent of the reader from then on.
+	class EntryMapping final
+	{
+	public:
+
+		EntryMapping();
+		EntryMapping(EntryMapping && other);
+		EntryMapping & operator = (EntryMapping && other);
+		~EntryMapping();
+
+		EntryMapping(const EntryMapping &) = delete;
+		EntryMapping & operator = (const EntryMapping &) = delete;
+
+		// Unmaps the data. The mapping becomes invalid.
+		void release();
+
+		bool isValid() const { return data != nullptr; }
+		explicit operator bool() const { return isValid(); }
+
+		// Entry data, valid while the mapping is. Null if invalid.
+		const std::uint8_t * getData() const { return data; }
+		std::size_t getSize() const { return sizeInBytes; }
+
+		// True if the data starts exactly at a page boundary, which only
+		// happens for entries written with a page-multiple alignment.
+		bool isPageAligned() const { return data != nullptr && data == mappedBase; }
+
+	private:
+
+		friend class LabArchiveReader;
+
+		const std::uint8_t * data;
+		std::size_t          sizeInBytes;
+		const std::uint8_t * mappedBase;
+		std::size_t          mappedSize;
+	};
+
 	// Disable copy and assignment.
 	LabArchiveReader(const LabArchiveReader &) = delete;
 	LabArchiveReader & operator = (const LabArchiveReader &) = delete;
 
 	// Construct with the name of the file that will be
 	// opened for reading by the open() method.
-	explicit LabArchiveReader(std::string filename);
+	explicit LabArchiveReader(std::string filename, OpenMode mode = OpenMode::LoadWholeFile);
 
 	// Open the archive using the path/name
 	// provided on construction.
 	bool open();
 
+	// Same as above, but overrides the open mode given on construction.
+	bool open(OpenMode mode);
+
+	// Mode used by the last/next call to open().
+	OpenMode getOpenMode() const;
+
+	// Path/name of the archive file given on construction.
+	const std::string & getFileName() const;
+
 	// Manually closes the archive file.
 	// Done automatically by the destructor.
 	void close();
@@ -51,45 +137,157 @@ public:
 	// Test if the archive was successfully opened.
 	bool isOpen() const;
 
+	// Returned by findEntry() when there is no such entry.
+	static constexpr std::size_t EntryNotFound = ~static_cast<std::size_t>(0);
+
+	// Number of valid entries loaded from the archive. Entries are indexed
+	// from zero to getEntryCount()-1, in the order they appear in the LAB.
+	std::size_t getEntryCount() const;
+
+	// Entries of the table on disk that were ignored when opening because they
+	// were corrupted or repeated a name, each logged to STDERR. Zero for a sound archive.
+	std::size_t getRejectedEntryCount() const { return labRejectedEntries; }
+
+	// Find an entry index by filename. Lookup is DOS-style, case-insensitive and with
+	// '/' and '\' treated alike. Returns EntryNotFound if there is no such entry.
+	std::size_t findEntry(const std::string & entryName) const;
+	std::size_t findEntry(const char * entryName, std::size_t length) const;
+
+	// Accessors for an entry index, which must be valid.
+	const char *  getEntryName(std::size_t index) const;       // Null terminated, points into the name list.
+	std::size_t   getEntrySize(std::size_t index) const;       // Size of the entry data in bytes.
+	std::uint32_t getEntryDataOffset(std::size_t index) const; // Absolute from the start of the archive.
+	const char *  getEntryTypeId(std::size_t index) const;     // 4CC type id, NOT null terminated.
+
+	// Index based versions of getEntryData() and readEntry() below.
+	const std::uint8_t * getEntryData(std::size_t index) const;
+	bool readEntry(std::size_t index, void * destBuffer, std::size_t bufferSizeBytes) const;
+
+	// Reads a batch of entries on background I/O threads and returns right away. The
+	// optional callback fires as each request completes and the future becomes ready
+	// with the number of successful reads once the whole batch is done. The reader and
+	// the destination buffers must stay valid until then. Like any std::async future,
+	// destroying it waits for the batch to finish.
+	std::future<int> readEntriesAsync(std::vector<ReadRequest> requests,
+	                                  ReadCallback onComplete = nullptr,
+	                                  int numThreads = 4) const;
+
+	// Computes the CRC-32C of the data of every entry, indexed like the entries.
+	// Entries are spread over numThreads threads; zero uses all CPU cores.
+	// Returns false if any entry can't be read. Errors logged to STDERR.
+	bool computeEntryChecksums(std::vector<std::uint32_t> & checksums, int numThreads = 0) const;
+
+	// Map the data of one entry from the archive file, in any open mode. Only
+	// the pages covering the entry are mapped. If the archive was packed with a
+	// page-multiple data alignment, the data starts at the mapping itself, ready
+	// for zero-copy use. Returns an invalid mapping for empty entries or on error.
+	EntryMapping mapEntry(std::size_t index) const;
+
+	// Test if the archive has an entry with the given filename.
+	bool hasEntry(const std::string & entryName) const;
+
+	// Get the size in bytes of a named entry. Zero and false if there is no such entry.
+	bool getEntrySize(const std::string & entryName, std::size_t & sizeInBytes) const;
+
+	// Zero-copy access to the data of a named entry. Points straight into the loaded
+	// or mapped archive and stays valid until close(). Returns null if there is no such
+	// entry or if the archive was opened as MetadataOnly, in which case use readEntry().
+	const std::uint8_t * getEntryData(const std::string & entryName, std::size_t * sizeInBytes = nullptr) const;
+
+	// Copy the data of a named entry into a caller provided buffer, which must be at
+	// least getEntrySize() bytes long. Works in any open mode. Returns false if there
+	// is no such entry, the buffer is too small or reading failed. Errors logged to STDERR.
+	bool readEntry(const std::string & entryName, void * destBuffer, std::size_t bufferSizeBytes) const;
+
 	// Print a list of all entries present in the LAB archive.
 	void listFileEntries(std::ostream & os = std::cout) const;
 
 	// Extracts all LAB archive files to the destination path, creating
 	// directories as needed and overwriting existing files. Returns the
 	// number of files successfully extracted. Errors logged to STDERR.
-	int extractWholeArchive(const std::string & destPath) const;
+	// Entries are spread over numThreads threads; zero uses all CPU cores.
+	int extractWholeArchive(const std::string & destPath, int numThreads = 1) const;
+
+	// Single-pass unpack from a stream that can't seek, like a pipe or STDIN. Parses the
+	// header and entry table from the front of the stream, then writes each entry selected
+	// by the filter as its bytes stream past, in data offset order. Only a small chunk of
+	// the archive is buffered at a time. streamName is used for error messages.
+	// Returns the number of files extracted, or -1 if the stream is not a valid LAB archive,
+	// ends before the data of a selected entry, or destPath can't be opened. Errors logged to STDERR.
+	static int extractFromStream(FILE * stream, const std::string & streamName,
+	                             const std::string & destPath, const EntryFilter & filter = EntryFilter{});
+
+	// Indexes of all entries selected by the filter, in archive order.
+	std::vector<std::size_t> findEntries(const EntryFilter & filter) const;
+
+	// Same as extractWholeArchive(), but only for the entries selected by
+	// the filter or the given list of entry indexes. Entries not extracted
+	// are not read at all when the archive is mapped or MetadataOnly.
+	int extractEntries(const std::string & destPath, const EntryFilter & filter, int numThreads = 1) const;
+	int extractEntries(const std::string & destPath, const std::vector<std::size_t> & indexes, int numThreads = 1) const;
+
+	// Record the first access to each entry through getEntryData(), readEntry(),
+	// readEntriesAsync() and mapEntry(), so a repacked archive can have its data
+	// laid out in the order it is actually read (see LabArchiveWriter::loadDataOrder()).
+	// Off by default. Enabling clears the current trace, and so does close().
+	// Set it while no other thread is reading from the archive.
+	void setAccessTracing(bool enable);
+	bool isAccessTracing() const { return accessTracing; }
+
+	// Names of the entries accessed so far, in first-access order.
+	std::vector<std::string> getAccessTrace() const;
+
+	// Writes the trace as an ordering file: one entry name per line.
+	// Returns false and logs to STDERR if the file can't be written.
+	bool saveAccessTrace(const std::string & filename) const;
 
 	// Destructor automatically closes the archive.
 	~LabArchiveReader();
 
 private:
 
-	bool loadArchiveMetadata();
-
-	struct TableEntry
+	//
+	// Entry table stored as struct-of-arrays; entry i is made of element
+	// i of each array. Names are not copied, they point into the name
+	// list inside labFileContents or the file mapping.
+	//
+	struct FileTable
 	{
-		std::uint32_t dataOffset;
-		std::uint32_t dataSizeBytes;
-		char          typeId[4]; // 4CC from the entry header, for displaying.
-
-		TableEntry(std::uint32_t offs, std::uint32_t size, const std::uint8_t id[4])
-			: dataOffset    { offs }
-			, dataSizeBytes { size }
-		{
-			typeId[0] = static_cast<char>(id[0]);
-			typeId[1] = static_cast<char>(id[1]);
-			typeId[2] = static_cast<char>(id[2]);
-			typeId[3] = static_cast<char>(id[3]);
-		}
+		std::vector<std::uint32_t> dataOffsets;
+		std::vector<std::uint32_t> dataSizes;
+		std::vector<char>          typeIds; // 4 chars per entry, from the entry header.
+		std::vector<const char *>  names;
+		LabNameIndex               nameIndex;
+
+		void reserve(std::size_t entryCount);
+		void clear();
+		std::size_t size() const { return names.size(); }
+		bool empty() const { return names.empty(); }
 	};
 
-	using FileTable   = std::unordered_map<std::string, TableEntry>;
 	using ByteVector  = std::vector<std::uint8_t>;
 
-	FILE *            labFileHandle;
-	ByteVector        labFileContents;
-	FileTable         labFileEntries;
-	const std::string labFileName;
+	bool readMetadataOnly(std::size_t fileSizeBytes);
+	bool loadArchiveMetadata();
+	bool writeEntryToFile(std::size_t index, FILE * fileOut) const;
+	void traceAccess(std::size_t index) const;
+
+	FILE *               labFileHandle;
+	const std::uint8_t * labMetadataPtr; // Start of the LAB header. Always valid while open.
+	const std::uint8_t * labDataPtr;     // Whole archive, in labFileContents or the mapping. Null if MetadataOnly.
+	std::size_t          labDataSize;    // Size in bytes of the whole archive file.
+	bool                 labIsMapped;    // labDataPtr is a file mapping that must be released on close().
+	OpenMode             labOpenMode;
+	ByteVector           labFileContents;
+	FileTable            labFileEntries;
+	std::size_t          labRejectedEntries; // Table entries left out of labFileEntries.
+	const std::string    labFileName;
+
+	// Access trace. Only touched when accessTracing is set; locked since reads may come from any thread.
+	bool                             accessTracing;
+	mutable std::mutex               traceMutex;
+	mutable std::vector<char>        traceSeen;  // Per entry, set on first access.
+	mutable std::vector<std::string> traceNames; // Entry names in first-access order.
 };
 
 } // namespace ol {}
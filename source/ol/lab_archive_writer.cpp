@@ -4,7 +4,7 @@
 // File: lab_archive_writer.cpp
 // Author: Guilherme R. Lampert
 // Created on: 23/09/15
-// Brief: Class that allows creating LucasArts LAB archives from loose files.
+// Brief: Class that allows creating LucasArts LAB archives from files or in-memory data.
 //
 // This project's source code is released under the MIT License.
 // - http://opensource.org/licenses/MIT
@@ -14,180 +14,828 @@
 #include "lab_archive_writer.hpp"
 #include "lab_common.hpp"
 #include "filesys_utils.hpp"
+#include "crc32c.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <unordered_map>
 #include <utility>
 
 namespace ol
 {
 
+// ========================================================
+// Local helpers:
+// ========================================================
+
+// Chunk size for entries that have to go through user memory.
+static const std::size_t CopyBufferSize = 64 * 1024;
+
+static bool writeZeros(LabOutputSink & sink, std::uint64_t sizeInBytes)
+{
+	static const std::uint8_t zeros[4096] = {};
+	while (sizeInBytes > 0)
+	{
+		const std::size_t chunkSize = (sizeInBytes < sizeof(zeros)) ? std::size_t(sizeInBytes) : sizeof(zeros);
+		if (!sink.write(zeros, chunkSize))
+		{
+			return false;
+		}
+		sizeInBytes -= chunkSize;
+	}
+	return true;
+}
+
+static std::unique_ptr<std::uint8_t[]> loadFileRange(const std::string & filename, const std::uint64_t offset,
+                                                     const std::size_t sizeInBytes)
+{
+	FILE * fileIn = std::fopen(filename.c_str(), "rb");
+	if (fileIn == nullptr)
+	{
+		return nullptr;
+	}
+
+	auto data = std::make_unique<std::uint8_t[]>(sizeInBytes);
+	const bool ok = filesys::readFileAt(fileIn, offset, data.get(), sizeInBytes);
+
+	std::fclose(fileIn);
+	return ok ? std::move(data) : nullptr;
+}
+
+static bool crc32cFileRange(const std::string & filename, const std::uint64_t offset,
+                            const std::size_t sizeInBytes, std::uint32_t & crc)
+{
+	FILE * fileIn = std::fopen(filename.c_str(), "rb");
+	if (fileIn == nullptr)
+	{
+		return false;
+	}
+
+	auto buffer = std::make_unique<std::uint8_t[]>(CopyBufferSize);
+	bool ok = true;
+	crc = 0;
+
+	for (std::size_t done = 0; ok && done < sizeInBytes;)
+	{
+		const std::size_t chunkSize = std::min(sizeInBytes - done, CopyBufferSize);
+		ok = filesys::readFileAt(fileIn, offset + done, buffer.get(), chunkSize);
+		crc = crc32c(buffer.get(), chunkSize, crc);
+		done += chunkSize;
+	}
+
+	std::fclose(fileIn);
+	return ok;
+}
+
 // ========================================================
 // class LabArchiveWriter:
 // ========================================================
 
+LabArchiveWriter::LabArchiveWriter()
+	: deduplicate       { false }
+	, duplicateCount    { 0 }
+	, bytesSavedByDedup { 0 }
+	, dataAlignment     { 1 }
+	, paddingBytes      { 0 }
+{ }
+
 LabArchiveWriter::LabArchiveWriter(std::string destArchive, std::string sourcePath)
-	: destLabFile { std::move(destArchive) }
-	, srcDataPath { std::move(sourcePath)  }
+	: destLabFile       { std::move(destArchive) }
+	, deduplicate       { false }
+	, duplicateCount    { 0 }
+	, bytesSavedByDedup { 0 }
+	, dataAlignment     { 1 }
+	, paddingBytes      { 0 }
 {
 	assert(!destLabFile.empty());
-	assert(!srcDataPath.empty());
+	assert(!sourcePath.empty());
 
-	fileList = filesys::listFilesInPath(srcDataPath);
-	if (fileList.empty())
+	addDirectory(sourcePath);
+}
+
+LabArchiveWriter::SourceEntry * LabArchiveWriter::newEntry(const std::string & entryName, const std::size_t sizeInBytes)
+{
+	if (entryName.empty())
+	{
+		std::cerr << "LAB entry names can't be empty!\n";
+		return nullptr;
+	}
+
+	// All offsets and sizes in a LAB are 32-bits.
+	if (sizeInBytes > UINT32_MAX)
 	{
-		std::cerr << "Warning: Could not find any files in path \'" << srcDataPath << "\'!\n";
+		std::cerr << "Entry \'" << entryName << "\' is too big for a LAB archive!\n";
+		return nullptr;
 	}
-	else // Ensure sorted.
+
+	std::string name = entryName;
+	std::replace(std::begin(name), std::end(name), '/', '\\');
+
+	if (!entryNames.insert(foldEntryName(name)).second)
 	{
-		std::sort(std::begin(fileList), std::end(fileList));
+		std::cerr << "Entry \'" << name << "\' was already added to the LAB archive!\n";
+		return nullptr;
 	}
+
+	SourceEntry entry;
+	entry.name         = std::move(name);
+	entry.sizeInBytes  = sizeInBytes;
+	entry.sourceOffset = 0;
+
+	sourceEntries.push_back(std::move(entry));
+	return &sourceEntries.back();
+}
+
+bool LabArchiveWriter::addEntry(const std::string & entryName, const void * data, const std::size_t sizeInBytes)
+{
+	assert(data != nullptr || sizeInBytes == 0);
+
+	const auto * bytes = static_cast<const std::uint8_t *>(data);
+	return addEntry(entryName, std::vector<std::uint8_t>(bytes, bytes + sizeInBytes));
 }
 
-bool LabArchiveWriter::write()
+bool LabArchiveWriter::addEntry(const std::string & entryName, std::vector<std::uint8_t> data)
 {
+	SourceEntry * entry = newEntry(entryName, data.size());
+	if (entry == nullptr)
+	{
+		return false;
+	}
+
+	entry->bytes = std::move(data);
+	return true;
+}
+
+bool LabArchiveWriter::addFile(const std::string & entryName, const std::string & sourceFile)
+{
+	std::size_t sizeInBytes = 0;
+	if (!filesys::queryFileSize(sourceFile, sizeInBytes))
+	{
+		std::cerr << "Failed to query size of file \'" << sourceFile << "\'!\n";
+		return false;
+	}
+
+	SourceEntry * entry = newEntry(entryName, sizeInBytes);
+	if (entry == nullptr)
+	{
+		return false;
+	}
+
+	entry->sourceFile = sourceFile;
+	return true;
+}
+
+bool LabArchiveWriter::addFileRange(const std::string & entryName, const std::string & sourceFile,
+                                    const std::uint64_t offset, const std::size_t sizeInBytes)
+{
+	assert(!sourceFile.empty());
+
+	SourceEntry * entry = newEntry(entryName, sizeInBytes);
+	if (entry == nullptr)
+	{
+		return false;
+	}
+
+	entry->sourceFile   = sourceFile;
+	entry->sourceOffset = offset;
+	return true;
+}
+
+bool LabArchiveWriter::addStream(const std::string & entryName, const std::size_t sizeInBytes, StreamReader reader)
+{
+	assert(reader != nullptr);
+
+	SourceEntry * entry = newEntry(entryName, sizeInBytes);
+	if (entry == nullptr)
+	{
+		return false;
+	}
+
+	entry->stream = std::move(reader);
+	return true;
+}
+
+bool LabArchiveWriter::addDirectory(const std::string & sourcePath)
+{
+	// Whole tree, already sorted. Sizes come with it, so no stat per file here.
+	const auto fileList = filesys::listFilesRecursive(sourcePath);
 	if (fileList.empty())
 	{
+		std::cerr << "Warning: Could not find any files in path \'" << sourcePath << "\'!\n";
+		return false;
+	}
+
+	sourceEntries.reserve(sourceEntries.size() + fileList.size());
+
+	bool allAdded = true;
+	for (const auto & listedFile : fileList)
+	{
+		SourceEntry * entry = newEntry(listedFile.path, static_cast<std::size_t>(listedFile.sizeInBytes));
+		if (entry == nullptr)
+		{
+			allAdded = false;
+			continue;
+		}
+		entry->sourceFile = sourcePath + listedFile.path;
+	}
+	return allAdded;
+}
+
+void LabArchiveWriter::setDataOrder(const std::vector<std::string> & orderedNames)
+{
+	dataOrderRanks.clear();
+	dataOrderRanks.reserve(orderedNames.size());
+
+	// A name listed twice keeps its first position.
+	for (const auto & name : orderedNames)
+	{
+		dataOrderRanks.emplace(foldEntryName(name), dataOrderRanks.size());
+	}
+}
+
+bool LabArchiveWriter::loadDataOrder(const std::string & orderFile)
+{
+	std::ifstream orderIn{ orderFile };
+	if (!orderIn)
+	{
+		std::cerr << "Can't open ordering file " << orderFile << "!\n";
+		return false;
+	}
+
+	std::vector<std::string> orderedNames;
+	std::string line;
+	while (std::getline(orderIn, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+		if (!line.empty() && line[0] != '#')
+		{
+			orderedNames.push_back(std::move(line));
+		}
+	}
+
+	setDataOrder(orderedNames);
+	return true;
+}
+
+bool LabArchiveWriter::write(const WriteMode mode, const int numThreads)
+{
+	if (destLabFile.empty())
+	{
+		std::cerr << "No destination file given for the LAB archive!\n";
+		return false;
+	}
+
+	LabFileSink sink{ destLabFile };
+	if (!sink.open())
+	{
+		return false;
+	}
+	return write(sink, mode, numThreads);
+}
+
+bool LabArchiveWriter::write(LabOutputSink & sink, const WriteMode mode, const int numThreads)
+{
+	outputName = sink.getName();
+
+	if (sourceEntries.empty())
+	{
+		std::cerr << "No entries to add to LAB archive " << outputName << "!\n";
 		return false;
 	}
 
 	//
-	// Build the LAB archive in main memory, them flush to file when ready.
-	// LABs are generally small, so this is unlikely to run out of memory
-	// on any modern machine.
+	// InMemory loads the source files into main memory, then writes the
+	// archive in one go. LABs are generally small, so this is unlikely to
+	// run out of memory on any modern machine. Streaming only needs the file
+	// sizes up front and copies each file straight into the archive, for
+	// arbitrarily big LABs. Entries added from memory or streams are written
+	// as they are in both modes.
 	//
 
-	struct FileInfo
-	{
-		std::size_t nameOffset;
-		std::size_t sizeInBytes;
-		std::unique_ptr<std::uint8_t[]> data;
+	assert(dataAlignment != 0);
 
-		FileInfo(std::size_t offs, std::size_t size, std::unique_ptr<std::uint8_t[]> ptr)
-			: nameOffset  { offs }
-			, sizeInBytes { size }
-			, data        { std::move(ptr) }
-		{ }
-	};
+	// Positional writes need a file. Parallel workers read the files
+	// themselves; loading them all up front would serialize that.
+	const bool parallel = (numThreads != 1 && sink.getFile() != nullptr);
 
-	std::vector<FileInfo> srcFileInfos;
+	std::vector<FileInfo> fileInfos;
+	std::vector<std::size_t> dataOrder;
 	std::uint32_t fileNameListLength = 0;
 
-	for (const auto & fileName : fileList)
+	if (!layoutEntries((parallel ? WriteMode::Streaming : mode), numThreads, fileInfos, dataOrder, fileNameListLength))
 	{
-		std::size_t dataSize = 0;
-		auto data = filesys::loadFile(srcDataPath + fileName, &dataSize);
+		return false;
+	}
 
-		if (data == nullptr)
+	std::uint64_t archiveSize = sizeof(LabHeader) + (fileInfos.size() * sizeof(LabFileEntry)) + fileNameListLength;
+	for (const auto & fileInfo : fileInfos)
+	{
+		archiveSize = std::max(archiveSize, std::uint64_t(fileInfo.dataOffset) + fileInfo.sizeInBytes);
+	}
+
+	if (parallel)
+	{
+		if (!writeParallel(sink, fileInfos, fileNameListLength, archiveSize, numThreads) || !sink.finish())
 		{
-			std::cerr << "Failed to load file \'" << fileName << "\'! Won't be added to LAB archive...\n";
-			// Put a nullptr in srcFileInfos anyway.
-			// We need its size to match fileList's.
+			std::cerr << "Failed to write LAB archive " << outputName << "!\n";
+			return false;
 		}
+		return true;
+	}
 
-		const std::size_t nameOffset = fileNameListLength;
-		srcFileInfos.emplace_back(nameOffset, dataSize, std::move(data));
+	sink.reserve(archiveSize);
+	if (!writeMetadata(sink, fileInfos, fileNameListLength))
+	{
+		return false;
+	}
 
-		// Size includes the null byte!
-		fileNameListLength += fileName.size() + 1;
+	// Now finally write the data for each file entry, zero filling any alignment gaps:
+	std::uint64_t position = sizeof(LabHeader) + (fileInfos.size() * sizeof(LabFileEntry)) + fileNameListLength;
+	for (const std::size_t i : dataOrder)
+	{
+		const auto & fileInfo = fileInfos[i];
+		if (fileInfo.sizeInBytes == 0 || fileInfo.duplicateOf != NotDuplicate)
+		{
+			continue;
+		}
+
+		if (fileInfo.dataOffset > position && !writeZeros(sink, fileInfo.dataOffset - position))
+		{
+			std::cerr << "Failed to write LAB alignment padding! " << outputName << ".\n";
+			return false;
+		}
+		if (!writeEntryData(sink, fileInfo, false))
+		{
+			return false;
+		}
+		position = std::uint64_t(fileInfo.dataOffset) + fileInfo.sizeInBytes;
 	}
 
-	assert(srcFileInfos.size() == fileList.size());
+	if (!sink.finish())
+	{
+		std::cerr << "Failed to flush LAB archive! " << outputName << ".\n";
+		return false;
+	}
+	return true;
+}
 
+bool LabArchiveWriter::writeParallel(LabOutputSink & sink, const std::vector<FileInfo> & fileInfos,
+                                     const std::uint32_t fileNameListLength, const std::uint64_t archiveSize,
+                                     const int numThreads) const
+{
 	//
-	// Once all files are loaded into memory, we can construct the archive.
+	// Every data offset is already known from the entry sizes, so the data
+	// section can be filled in any order. Reserve the whole file first, so
+	// concurrent positional writes don't keep extending it, then let the
+	// workers copy whole files to their slots.
 	//
 
-	filesys::createPath(destLabFile);
-	FILE * fileOut = std::fopen(destLabFile.c_str(), "wb");
+	FILE * fileOut = sink.getFile();
+	assert(fileOut != nullptr);
 
-	if (fileOut == nullptr)
+	if (!filesys::preallocateFile(fileOut, archiveSize))
 	{
-		std::cerr << "Failed to open file " << destLabFile << " for writing!\n";
+		std::cerr << "Failed to preallocate " << archiveSize << " bytes for " << outputName << "!\n";
 		return false;
 	}
 
-	const std::uint32_t fileCount = static_cast<std::uint32_t>(fileList.size());
+	// Metadata goes through the stream as usual; flushed before the workers start.
+	if (!writeMetadata(sink, fileInfos, fileNameListLength) || std::fflush(fileOut) != 0)
+	{
+		return false;
+	}
 
-	LabHeader labHeader;
-	labHeader.id[0]              = 'L';
-	labHeader.id[1]              = 'A';
-	labHeader.id[2]              = 'B';
-	labHeader.id[3]              = 'N';
-	labHeader.unknown            = 0x10000; // This value seems to be used on all archives tested.
-	labHeader.fileCount          = fileCount;
-	labHeader.fileNameListLength = fileNameListLength;
+	std::atomic<bool> allWritten{ true };
+	parallelFor(fileInfos.size(), numThreads, [&](const std::size_t i)
+	{
+		if (!allWritten.load(std::memory_order_relaxed))
+		{
+			return; // Give up early if another worker failed.
+		}
+
+		// Stream readers may share state, so they are left for this thread.
+		if (sourceEntries[fileInfos[i].entryIndex].stream != nullptr)
+		{
+			return;
+		}
 
-	if (std::fwrite(&labHeader, sizeof(labHeader), 1, fileOut) != 1)
+		if (!writeEntryData(sink, fileInfos[i], true))
+		{
+			allWritten = false;
+		}
+	});
+
+	for (const auto & fileInfo : fileInfos)
 	{
-		std::cerr << "Failed to write LAB header! " << destLabFile << ".\n";
-		std::fclose(fileOut);
+		if (allWritten && sourceEntries[fileInfo.entryIndex].stream != nullptr &&
+		    !writeEntryData(sink, fileInfo, true))
+		{
+			allWritten = false;
+		}
+	}
+
+	return allWritten;
+}
+
+bool LabArchiveWriter::layoutEntries(const WriteMode mode, const int numThreads, std::vector<FileInfo> & fileInfos,
+                                     std::vector<std::size_t> & dataOrder, std::uint32_t & fileNameListLength)
+{
+	fileInfos.clear();
+	fileInfos.reserve(sourceEntries.size());
+
+	std::uint64_t nameListLength = 0;
+
+	for (std::size_t i = 0; i < sourceEntries.size(); ++i)
+	{
+		const auto & entry = sourceEntries[i];
+
+		FileInfo fileInfo;
+		fileInfo.entryIndex  = i;
+		fileInfo.sizeInBytes = entry.sizeInBytes;
+		fileInfo.duplicateOf = NotDuplicate;
+
+		// Empty files are still added, they just have no data to load.
+		bool ok = true;
+		if (mode == WriteMode::InMemory && !entry.sourceFile.empty() && fileInfo.sizeInBytes != 0)
+		{
+			fileInfo.data = loadFileRange(entry.sourceFile, entry.sourceOffset, fileInfo.sizeInBytes);
+			ok = (fileInfo.data != nullptr);
+		}
+
+		if (!ok)
+		{
+			std::cerr << "Failed to load file \'" << entry.sourceFile << "\'! Won't be added to LAB archive...\n";
+			continue;
+		}
+
+		fileInfo.nameOffset = static_cast<std::uint32_t>(nameListLength);
+		fileInfo.dataOffset = 0; // Set below, once the name list length is known.
+
+		// Size includes the null byte!
+		nameListLength += entry.name.size() + 1;
+
+		fileInfos.push_back(std::move(fileInfo));
+	}
+
+	if (fileInfos.empty())
+	{
+		std::cerr << "No readable files to add to LAB archive " << outputName << "!\n";
 		return false;
 	}
 
-	std::uint32_t dataOffset = sizeof(LabHeader) +
-		(fileCount * sizeof(LabFileEntry)) + fileNameListLength;
+	// Table order unless an ordering was given; unlisted entries keep their relative order after the listed ones.
+	dataOrder.resize(fileInfos.size());
+	for (std::size_t i = 0; i < dataOrder.size(); ++i)
+	{
+		dataOrder[i] = i;
+	}
+
+	if (!dataOrderRanks.empty())
+	{
+		std::vector<std::size_t> ranks(fileInfos.size(), ~std::size_t(0));
+		for (std::size_t i = 0; i < fileInfos.size(); ++i)
+		{
+			const auto iter = dataOrderRanks.find(foldEntryName(sourceEntries[fileInfos[i].entryIndex].name));
+			if (iter != dataOrderRanks.end())
+			{
+				ranks[i] = iter->second;
+			}
+		}
+
+		std::stable_sort(std::begin(dataOrder), std::end(dataOrder),
+			[&ranks](const std::size_t a, const std::size_t b) { return ranks[a] < ranks[b]; });
+	}
 
-	// Write the entry headers:
-	for (std::uint32_t i = 0; i < fileCount; ++i)
+	duplicateCount    = 0;
+	bytesSavedByDedup = 0;
+	if (deduplicate)
 	{
-		const auto & fileName = fileList[i];
-		const auto & fileInfo = srcFileInfos[i];
+		findDuplicates(fileInfos, dataOrder, numThreads);
+	}
+
+	// Empty entries aren't aligned, they take no space in the data section.
+	// Duplicates are resolved afterwards, once every original has its offset.
+	const std::uint64_t metadataSize = sizeof(LabHeader) + (fileInfos.size() * sizeof(LabFileEntry)) + nameListLength;
+	std::uint64_t dataOffset = metadataSize;
+	paddingBytes = 0;
 
-		if (fileInfo.data == nullptr)
+	for (const std::size_t i : dataOrder)
+	{
+		auto & fileInfo = fileInfos[i];
+		if (fileInfo.duplicateOf != NotDuplicate)
 		{
 			continue;
 		}
 
-		LabFileEntry labEntry;
-		labEntry.dataOffset  = dataOffset;
-		labEntry.nameOffset  = static_cast<std::uint32_t>(fileInfo.nameOffset);
-		labEntry.sizeInBytes = static_cast<std::uint32_t>(fileInfo.sizeInBytes);
-		fileTypeIdForFileName(labEntry.typeId, fileName, destLabFile);
+		if (fileInfo.sizeInBytes != 0)
+		{
+			const std::uint64_t alignedOffset = (dataOffset + dataAlignment - 1) / dataAlignment * dataAlignment;
+			paddingBytes += alignedOffset - dataOffset;
+			dataOffset = alignedOffset;
+		}
 
-		if (std::fwrite(&labEntry, sizeof(labEntry), 1, fileOut) != 1)
+		// All offsets and sizes in a LAB are 32-bits.
+		if (dataOffset + fileInfo.sizeInBytes > UINT32_MAX)
 		{
-			std::cerr << "Failed to write LAB entry header! " << destLabFile << ".\n";
-			std::fclose(fileOut);
+			std::cerr << "LAB archive " << outputName << " would exceed the 4GB limit of the format!\n";
 			return false;
 		}
 
+		fileInfo.dataOffset = static_cast<std::uint32_t>(dataOffset);
 		dataOffset += fileInfo.sizeInBytes;
 	}
 
-	// Write the filename list (null terminated strings, including the null byte):
-	for (const auto & fileName : fileList)
+	for (auto & fileInfo : fileInfos)
 	{
-		if (std::fwrite(fileName.c_str(), sizeof(char),
-		    fileName.length() + 1, fileOut) != fileName.length() + 1)
+		if (fileInfo.duplicateOf != NotDuplicate)
 		{
-			std::cerr << "Failed to write LAB entry name! " << destLabFile << ".\n";
-			std::fclose(fileOut);
-			return false;
+			fileInfo.dataOffset = fileInfos[fileInfo.duplicateOf].dataOffset;
 		}
 	}
 
-	// Now finally write the data for each file entry:
-	for (std::uint32_t i = 0; i < fileCount; ++i)
+	fileNameListLength = static_cast<std::uint32_t>(nameListLength);
+	return true;
+}
+
+const std::uint8_t * LabArchiveWriter::getMemoryData(const FileInfo & fileInfo) const
+{
+	if (fileInfo.data != nullptr)
+	{
+		return fileInfo.data.get();
+	}
+
+	const auto & entry = sourceEntries[fileInfo.entryIndex];
+	if (entry.sourceFile.empty() && entry.stream == nullptr)
 	{
-		const auto & fileInfo = srcFileInfos[i];
-		if (fileInfo.data == nullptr)
+		return entry.bytes.data();
+	}
+	return nullptr;
+}
+
+void LabArchiveWriter::findDuplicates(std::vector<FileInfo> & fileInfos, const std::vector<std::size_t> & dataOrder,
+                                      const int numThreads)
+{
+	//
+	// Hashing reads every byte of every file, so it is spread over the
+	// threads. Grouping by size and checksum is cheap and done serially.
+	// A matching checksum is never trusted alone; the contents are compared.
+	//
+
+	std::vector<std::uint32_t> checksums(fileInfos.size(), 0);
+	std::vector<char> hashed(fileInfos.size(), 0);
+
+	parallelFor(fileInfos.size(), numThreads, [&](const std::size_t i)
+	{
+		const auto & fileInfo = fileInfos[i];
+		const auto & entry    = sourceEntries[fileInfo.entryIndex];
+
+		// Nothing to share for empty entries, and streams can only be read once.
+		if (fileInfo.sizeInBytes == 0 || entry.stream != nullptr)
+		{
+			return;
+		}
+
+		if (const std::uint8_t * data = getMemoryData(fileInfo))
+		{
+			checksums[i] = crc32c(data, fileInfo.sizeInBytes);
+			hashed[i] = 1;
+		}
+		else
+		{
+			// Files that can't be read now are left alone; writing them will report the error.
+			hashed[i] = crc32cFileRange(entry.sourceFile, entry.sourceOffset, fileInfo.sizeInBytes, checksums[i]);
+		}
+	});
+
+	// In data order, so each group keeps the data of the entry that is read first.
+	std::unordered_map<std::uint64_t, std::vector<std::size_t>> uniqueFiles;
+	for (const std::size_t i : dataOrder)
+	{
+		if (!hashed[i])
+		{
+			continue;
+		}
+
+		auto & fileInfo = fileInfos[i];
+		const std::uint64_t key = (std::uint64_t(fileInfo.sizeInBytes) << 32) ^ checksums[i];
+		auto & candidates = uniqueFiles[key];
+
+		for (const std::size_t c : candidates)
+		{
+			if (fileInfos[c].sizeInBytes == fileInfo.sizeInBytes && checksums[c] == checksums[i] &&
+			    sameContents(fileInfos[c], fileInfo))
+			{
+				fileInfo.duplicateOf = c;
+				break;
+			}
+		}
+
+		if (fileInfo.duplicateOf == NotDuplicate)
 		{
+			candidates.push_back(i);
 			continue;
 		}
 
-		if (std::fwrite(fileInfo.data.get(), sizeof(std::uint8_t),
-		    fileInfo.sizeInBytes, fileOut) != fileInfo.sizeInBytes)
+		++duplicateCount;
+		bytesSavedByDedup += fileInfo.sizeInBytes;
+		fileInfo.data.reset(); // Not written, so no need to keep it around.
+	}
+}
+
+bool LabArchiveWriter::sameContents(const FileInfo & a, const FileInfo & b) const
+{
+	assert(a.sizeInBytes == b.sizeInBytes);
+
+	const std::uint8_t * memoryA = getMemoryData(a);
+	const std::uint8_t * memoryB = getMemoryData(b);
+
+	if (memoryA != nullptr && memoryB != nullptr)
+	{
+		return std::memcmp(memoryA, memoryB, a.sizeInBytes) == 0;
+	}
+
+	// Either side may be a file, compared a chunk at a time.
+	const auto & entryA = sourceEntries[a.entryIndex];
+	const auto & entryB = sourceEntries[b.entryIndex];
+	FILE * fileA = (memoryA == nullptr) ? std::fopen(entryA.sourceFile.c_str(), "rb") : nullptr;
+	FILE * fileB = (memoryB == nullptr) ? std::fopen(entryB.sourceFile.c_str(), "rb") : nullptr;
+	bool equal = (memoryA != nullptr || fileA != nullptr) && (memoryB != nullptr || fileB != nullptr);
+
+	auto bufferA = std::make_unique<std::uint8_t[]>(CopyBufferSize);
+	auto bufferB = std::make_unique<std::uint8_t[]>(CopyBufferSize);
+
+	std::size_t offset = 0;
+	while (equal && offset < a.sizeInBytes)
+	{
+		const std::size_t chunkSize = std::min(a.sizeInBytes - offset, CopyBufferSize);
+
+		const std::uint8_t * chunkA = (memoryA != nullptr) ? memoryA + offset :
+			(filesys::readFileAt(fileA, entryA.sourceOffset + offset, bufferA.get(), chunkSize) ? bufferA.get() : nullptr);
+		const std::uint8_t * chunkB = (memoryB != nullptr) ? memoryB + offset :
+			(filesys::readFileAt(fileB, entryB.sourceOffset + offset, bufferB.get(), chunkSize) ? bufferB.get() : nullptr);
+
+		equal = (chunkA != nullptr && chunkB != nullptr && std::memcmp(chunkA, chunkB, chunkSize) == 0);
+		offset += chunkSize;
+	}
+
+	if (fileA != nullptr) { std::fclose(fileA); }
+	if (fileB != nullptr) { std::fclose(fileB); }
+	return equal;
+}
+
+bool LabArchiveWriter::writeMetadata(LabOutputSink & sink, const std::vector<FileInfo> & fileInfos,
+                                     const std::uint32_t fileNameListLength) const
+{
+	LabHeader labHeader;
+	labHeader.id[0]              = 'L';
+	labHeader.id[1]              = 'A';
+	labHeader.id[2]              = 'B';
+	labHeader.id[3]              = 'N';
+	labHeader.unknown            = 0x10000; // This value seems to be used on all archives tested.
+	labHeader.fileCount          = static_cast<std::uint32_t>(fileInfos.size());
+	labHeader.fileNameListLength = fileNameListLength;
+
+	if (!sink.write(&labHeader, sizeof(labHeader)))
+	{
+		std::cerr << "Failed to write LAB header! " << outputName << ".\n";
+		return false;
+	}
+
+	// Write the entry headers, all in one block:
+	std::vector<LabFileEntry> labEntries(fileInfos.size());
+	for (std::size_t i = 0; i < fileInfos.size(); ++i)
+	{
+		labEntries[i].dataOffset  = fileInfos[i].dataOffset;
+		labEntries[i].nameOffset  = fileInfos[i].nameOffset;
+		labEntries[i].sizeInBytes = static_cast<std::uint32_t>(fileInfos[i].sizeInBytes);
+		fileTypeIdForFileName(labEntries[i].typeId, sourceEntries[fileInfos[i].entryIndex].name, outputName);
+	}
+
+	if (!sink.write(labEntries.data(), labEntries.size() * sizeof(LabFileEntry)))
+	{
+		std::cerr << "Failed to write LAB entry headers! " << outputName << ".\n";
+		return false;
+	}
+
+	// Write the filename list (null terminated strings, including the null byte).
+	// Names already have the DOS style separators, e.g. "sounds\door.wav":
+	std::string nameList;
+	nameList.reserve(fileNameListLength);
+	for (const auto & fileInfo : fileInfos)
+	{
+		nameList += sourceEntries[fileInfo.entryIndex].name;
+		nameList += '\0';
+	}
+
+	if (!sink.write(nameList.data(), nameList.size()))
+	{
+		std::cerr << "Failed to write LAB entry names! " << outputName << ".\n";
+		return false;
+	}
+
+	return true;
+}
+
+bool LabArchiveWriter::writeEntryChunk(LabOutputSink & sink, const FileInfo & fileInfo, const bool atDataOffset,
+                                       const std::uint64_t chunkOffset, const void * chunk, const std::size_t chunkSize) const
+{
+	return atDataOffset ?
+		filesys::writeFileAt(sink.getFile(), fileInfo.dataOffset + chunkOffset, chunk, chunkSize) :
+		sink.write(chunk, chunkSize);
+}
+
+bool LabArchiveWriter::writeEntryData(LabOutputSink & sink, const FileInfo & fileInfo,
+                                      const bool atDataOffset) const
+{
+	// Duplicates share the data written for another entry.
+	if (fileInfo.sizeInBytes == 0 || fileInfo.duplicateOf != NotDuplicate)
+	{
+		return true;
+	}
+
+	const auto & entry = sourceEntries[fileInfo.entryIndex];
+
+	if (const std::uint8_t * data = getMemoryData(fileInfo))
+	{
+		if (!writeEntryChunk(sink, fileInfo, atDataOffset, 0, data, fileInfo.sizeInBytes))
 		{
-			std::cerr << "Failed to write LAB entry data! " << destLabFile << ".\n";
-			std::fclose(fileOut);
+			std::cerr << "Failed to write LAB entry data! " << outputName << ".\n";
 			return false;
 		}
+		return true;
 	}
 
-	std::fclose(fileOut);
+	// The entry table is already written, so a stream must produce exactly the promised size.
+	if (entry.stream != nullptr)
+	{
+		auto buffer = std::make_unique<std::uint8_t[]>(CopyBufferSize);
+		std::uint64_t offset = 0;
+		while (offset < fileInfo.sizeInBytes)
+		{
+			const std::size_t maxBytes  = static_cast<std::size_t>(std::min<std::uint64_t>(fileInfo.sizeInBytes - offset, CopyBufferSize));
+			const std::size_t chunkSize = entry.stream(buffer.get(), maxBytes);
+
+			if (chunkSize == 0 || chunkSize > maxBytes)
+			{
+				std::cerr << "Stream for entry \'" << entry.name << "\' ended after " << offset
+				          << " of " << fileInfo.sizeInBytes << " bytes!\n";
+				return false;
+			}
+			if (!writeEntryChunk(sink, fileInfo, atDataOffset, offset, buffer.get(), chunkSize))
+			{
+				std::cerr << "Failed to write LAB entry data! " << outputName << ".\n";
+				return false;
+			}
+			offset += chunkSize;
+		}
+		return true;
+	}
+
+	FILE * fileIn = std::fopen(entry.sourceFile.c_str(), "rb");
+	if (fileIn == nullptr)
+	{
+		std::cerr << "Failed to open file \'" << entry.sourceFile << "\' for reading!\n";
+		return false;
+	}
+
+	// Kernel-side copy where the sink is a file, no round trip through user memory.
+	// The entry table is already written, so the file must still have the size it
+	// had when it was added; a short copy fails.
+	bool copied = true;
+	if (FILE * fileOut = sink.getFile())
+	{
+		copied = atDataOffset ?
+			filesys::copyFileRangeAt(fileIn, entry.sourceOffset, fileOut, fileInfo.dataOffset, fileInfo.sizeInBytes) :
+			filesys::copyFileRange(fileIn, entry.sourceOffset, fileOut, fileInfo.sizeInBytes);
+	}
+	else
+	{
+		auto buffer = std::make_unique<std::uint8_t[]>(CopyBufferSize);
+		for (std::size_t done = 0; copied && done < fileInfo.sizeInBytes;)
+		{
+			const std::size_t chunkSize = std::min(fileInfo.sizeInBytes - done, CopyBufferSize);
+			copied = filesys::readFileAt(fileIn, entry.sourceOffset + done, buffer.get(), chunkSize) &&
+			         sink.write(buffer.get(), chunkSize);
+			done += chunkSize;
+		}
+	}
+
+	std::fclose(fileIn);
+
+	if (!copied)
+	{
+		std::cerr << "Failed to copy file \'" << entry.sourceFile << "\' into LAB archive " << outputName
+		          << "! Was it modified while packing?\n";
+		return false;
+	}
 	return true;
 }
 
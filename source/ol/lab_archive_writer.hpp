@@ -4,7 +4,7 @@
 // File: lab_archive_writer.hpp
 // Author: Guilherme R. Lampert
 // Created on: 23/09/15
-// Brief: Class that allows creating LucasArts LAB archives from loose files.
+// Brief: Class that allows creating LucasArts LAB archives from files or in-memory data.
 //
 // This project's source code is released under the MIT License.
 // - http://opensource.org/licenses/MIT
@@ -14,9 +14,17 @@
 #ifndef OL_LAB_ARCHIVE_WRITER_HPP
 #define OL_LAB_ARCHIVE_WRITER_HPP
 
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "lab_output_sink.hpp"
+
 namespace ol
 {
 
@@ -28,23 +36,182 @@ class LabArchiveWriter final
 {
 public:
 
+	// How write() gets the source file contents into the archive.
+	enum class WriteMode
+	{
+		// Load every file into memory first, then write the archive in one go.
+		// Peak memory use is the total size of the archive.
+		InMemory,
+
+		// Only query the file sizes up front. Data is copied from each source
+		// file by the kernel where supported (copy_file_range on Linux, which
+		// can share blocks on reflink file systems), or through a small buffer,
+		// so memory use is constant.
+		Streaming
+	};
+
+	// Produces the data of a stream entry in order: fills dest with up to maxBytes
+	// and returns how many were written. Returning 0 before the size given to
+	// addStream() was produced fails the write.
+	using StreamReader = std::function<std::size_t(void * dest, std::size_t maxBytes)>;
+
 	// Disable copy and assignment.
 	LabArchiveWriter(const LabArchiveWriter &) = delete;
 	LabArchiveWriter & operator = (const LabArchiveWriter &) = delete;
 
-	// Construct with the name of the output LAB archive
-	// and the path where to look for files to pack.
+	// Construct with no entries. Add them with the add*() methods below,
+	// then write the archive to a sink with write(sink).
+	LabArchiveWriter();
+
+	// Construct with the name of the output LAB archive and the path where to
+	// look for files to pack. Same as addDirectory(sourcePath).
 	LabArchiveWriter(std::string destArchive, std::string sourcePath);
 
-	// Writes the LAB archive to its destination file.
-	// Files from the source path are only opened now.
-	bool write();
+	//
+	// Entries are written in the order they were added. Names are stored
+	// with backslashes as separators like DOS did, whichever slash is given,
+	// and must be unique, ignoring case. Each method returns false and logs
+	// to STDERR if the entry can't be added.
+	//
+
+	// Copy of the given bytes.
+	bool addEntry(const std::string & entryName, const void * data, std::size_t sizeInBytes);
+
+	// Takes ownership of the buffer, no copy.
+	bool addEntry(const std::string & entryName, std::vector<std::uint8_t> data);
+
+	// Contents of a file on disk. Only its size is queried now; the file is read by write().
+	bool addFile(const std::string & entryName, const std::string & sourceFile);
+
+	// A range of bytes from a file, e.g. an entry of an existing archive, which is
+	// copied over without unpacking it. The range is only read by write().
+	bool addFileRange(const std::string & entryName, const std::string & sourceFile,
+	                  std::uint64_t offset, std::size_t sizeInBytes);
+
+	// Data pulled from the reader by write(), in order. The size must be
+	// known up front since the entry table comes before the data. Streams
+	// are consumed, so write() can't be repeated and they are never deduplicated.
+	bool addStream(const std::string & entryName, std::size_t sizeInBytes, StreamReader reader);
+
+	// Every file under sourcePath, subdirectories included, with names relative
+	// to it, e.g. "sounds\door.wav". Same as addFile() for each one, sorted by name.
+	bool addDirectory(const std::string & sourcePath);
+
+	std::size_t getEntryCount() const { return sourceEntries.size(); }
+
+	// Lay out entry data in the given order, e.g. the first-access order recorded by
+	// LabArchiveReader::saveAccessTrace(), so files loaded together are read back
+	// sequentially. Listed entries come first, in list order, then the rest in the
+	// order they were added. Names that weren't added are ignored. The entry table
+	// keeps the order entries were added in; only where their data sits changes.
+	void setDataOrder(const std::vector<std::string> & orderedNames);
+
+	// Same as above, from an ordering file with one entry name per line.
+	// Empty lines and lines starting with '#' are skipped.
+	bool loadDataOrder(const std::string & orderFile);
+
+	// Writes the LAB archive to the destination file given to the constructor.
+	// Files added with addFile()/addDirectory() are only opened now.
+	// With numThreads other than 1 (zero = one per CPU core), the output is
+	// preallocated and the data section is filled by parallel workers, each
+	// copying whole entries to their precomputed offsets. Files are then always
+	// streamed, whatever the mode.
+	bool write(WriteMode mode = WriteMode::InMemory, int numThreads = 1);
+
+	// Writes the LAB archive to any sink. Parallel workers and kernel-side
+	// copies are only used when the sink is backed by a file (getFile());
+	// other sinks receive the archive front to back on the calling thread.
+	// The sink is finished (flushed/closed) on success.
+	bool write(LabOutputSink & sink, WriteMode mode = WriteMode::InMemory, int numThreads = 1);
+
+	// Store byte-identical files only once, with all their entries pointing
+	// at the same data. Files are matched by size and CRC-32C, then compared
+	// byte for byte. Off by default. Must be set before write().
+	void setDeduplication(bool enable) { deduplicate = enable; }
+	bool isDeduplicating() const { return deduplicate; }
+
+	// Results of deduplication from the last write(): number of entries that
+	// share another's data and the bytes that were saved by that.
+	std::size_t getDuplicateCount() const { return duplicateCount; }
+	std::uint64_t getBytesSavedByDedup() const { return bytesSavedByDedup; }
+
+	// Start the data of each entry at a multiple of alignment bytes from the start
+	// of the archive, zero filling the gaps. 1 (the default) packs entries back to
+	// back. A multiple of the page size, e.g. 4096, allows page-aligned mappings of
+	// single entries and O_DIRECT reads. Must be set before write().
+	void setDataAlignment(std::uint32_t alignment) { dataAlignment = (alignment != 0) ? alignment : 1; }
+	std::uint32_t getDataAlignment() const { return dataAlignment; }
+
+	// Bytes of zero fill added for alignment by the last write().
+	std::uint64_t getPaddingBytes() const { return paddingBytes; }
 
 private:
 
-	std::vector<std::string> fileList;
-	const std::string destLabFile;
-	const std::string srcDataPath;
+	struct SourceEntry
+	{
+		std::string               name;        // As stored in the archive.
+		std::size_t               sizeInBytes;
+		std::vector<std::uint8_t> bytes;       // addEntry().
+		std::string               sourceFile;  // addFile(), addFileRange(), addDirectory().
+		std::uint64_t             sourceOffset; // Start of the data in sourceFile.
+		StreamReader              stream;      // addStream().
+	};
+
+	struct FileInfo
+	{
+		std::size_t   entryIndex;  // Into sourceEntries.
+		std::uint32_t nameOffset;
+		std::uint32_t dataOffset;
+		std::size_t   sizeInBytes;
+		std::unique_ptr<std::uint8_t[]> data; // Loaded source file for WriteMode::InMemory, else null.
+		std::size_t   duplicateOf; // Index of the entry holding the data, or NotDuplicate.
+	};
+
+	static constexpr std::size_t NotDuplicate = ~std::size_t(0);
+
+	// Validates the name and appends a new entry, returning it. Null on a bad or repeated name.
+	SourceEntry * newEntry(const std::string & entryName, std::size_t sizeInBytes);
+
+	// Data already in memory for the entry, either added that way or loaded. Null otherwise.
+	const std::uint8_t * getMemoryData(const FileInfo & fileInfo) const;
+
+	// Sizes (and for InMemory also loads) the source files and assigns the
+	// name and data offsets. Files that can't be read are left out.
+	// dataOrder receives the fileInfos indexes sorted by where their data goes.
+	bool layoutEntries(WriteMode mode, int numThreads, std::vector<FileInfo> & fileInfos,
+	                   std::vector<std::size_t> & dataOrder, std::uint32_t & fileNameListLength);
+
+	// Checksums the entries on numThreads threads and links each duplicate to the
+	// first entry in data order with the same contents. Updates the dedup counters.
+	void findDuplicates(std::vector<FileInfo> & fileInfos, const std::vector<std::size_t> & dataOrder, int numThreads);
+	bool sameContents(const FileInfo & a, const FileInfo & b) const;
+
+	// Header, entry table and name list.
+	bool writeMetadata(LabOutputSink & sink, const std::vector<FileInfo> & fileInfos, std::uint32_t fileNameListLength) const;
+
+	// Preallocates the output file, writes the metadata and then fills in the data section from numThreads workers.
+	bool writeParallel(LabOutputSink & sink, const std::vector<FileInfo> & fileInfos,
+	                   std::uint32_t fileNameListLength, std::uint64_t archiveSize, int numThreads) const;
+
+	// Entry data from memory, a stream or copied from the source file. Appended
+	// to the sink, or written at the entry's dataOffset with positional writes
+	// to the sink's file if atDataOffset is set (for parallel writers).
+	bool writeEntryData(LabOutputSink & sink, const FileInfo & fileInfo, bool atDataOffset) const;
+	bool writeEntryChunk(LabOutputSink & sink, const FileInfo & fileInfo, bool atDataOffset,
+	                     std::uint64_t chunkOffset, const void * chunk, std::size_t chunkSize) const;
+
+	std::vector<SourceEntry>        sourceEntries;
+	std::unordered_set<std::string> entryNames; // foldEntryName() keys, to reject repeated names.
+	std::unordered_map<std::string, std::size_t> dataOrderRanks; // foldEntryName() key => position in the data order.
+	const std::string               destLabFile;
+	std::string                     outputName; // Of the sink being written.
+
+	bool          deduplicate;
+	std::size_t   duplicateCount;
+	std::uint64_t bytesSavedByDedup;
+
+	std::uint32_t dataAlignment;
+	std::uint64_t paddingBytes;
 };
 
 } // namespace ol {}
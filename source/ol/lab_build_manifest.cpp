@@ -0,0 +1,245 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_build_manifest.cpp
+// Created on: 16/10/26
+// Brief: Sidecar manifest describing how a LAB archive was packed, for incremental repacks.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#include "lab_build_manifest.hpp"
+#include "lab_common.hpp"
+#include "filesys_utils.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <utility>
+
+namespace ol
+{
+
+// ========================================================
+// class LabBuildManifest:
+// ========================================================
+
+LabBuildManifest::LabBuildManifest()
+	: archiveSize         { 0 }
+	, archiveModifiedTime { 0 }
+	, dataAlignment       { 1 }
+	, deduplicated        { false }
+	, dataOrderChecksum   { 0 }
+{ }
+
+bool LabBuildManifest::load(const std::string & manifestFile)
+{
+	clearEntries();
+	archiveSize         = 0;
+	archiveModifiedTime = 0;
+
+	std::ifstream manifest{ manifestFile };
+	if (!manifest)
+	{
+		return false;
+	}
+
+	std::string line;
+	int lineNum = 0;
+	bool ok = true;
+
+	while (ok && std::getline(manifest, line))
+	{
+		++lineNum;
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		const char * str = line.c_str();
+		char * end = nullptr;
+
+		if (std::strncmp(str, "!archive ", 9) == 0)
+		{
+			archiveSize         = std::strtoull(str + 9, &end, 10);
+			archiveModifiedTime = std::strtoll(end, &end, 10);
+			ok = (*end == '\0');
+			continue;
+		}
+		if (std::strncmp(str, "!options ", 9) == 0)
+		{
+			dataAlignment = static_cast<std::uint32_t>(std::strtoul(str + 9, &end, 10));
+			deduplicated  = (std::strtoul(end, &end, 10) != 0);
+			dataOrderChecksum = static_cast<std::uint32_t>(std::strtoul(end, &end, 16)); // Absent if no order was set.
+			ok = (*end == '\0' && dataAlignment != 0);
+			continue;
+		}
+
+		// "<crc32c hex> <size> <mtime> <offset> <name>"
+		Entry entry;
+		entry.checksum     = static_cast<std::uint32_t>(std::strtoul(str, &end, 16));
+		const char * field = end;
+		entry.sizeInBytes  = std::strtoull(field, &end, 10);
+		ok = (end != field);
+		field = end;
+		entry.modifiedTime = std::strtoll(field, &end, 10);
+		ok = ok && (end != field);
+		field = end;
+		entry.dataOffset   = static_cast<std::uint32_t>(std::strtoul(field, &end, 10));
+		ok = ok && (end != field) && (*end == ' ') && (end[1] != '\0');
+
+		if (ok)
+		{
+			entry.name = end + 1;
+			entries.push_back(std::move(entry));
+		}
+	}
+
+	if (!ok)
+	{
+		std::cerr << "Bad manifest line " << lineNum << " in " << manifestFile << "!\n";
+		clearEntries();
+		return false;
+	}
+
+	rebuildIndex();
+	if (entryIndex.size() != entries.size())
+	{
+		std::cerr << "Repeated entry names in manifest " << manifestFile << "!\n";
+		clearEntries();
+		return false;
+	}
+	return true;
+}
+
+bool LabBuildManifest::save(const std::string & manifestFile) const
+{
+	const std::string tempFile = manifestFile + ".tmp";
+	{
+		std::ofstream manifest{ tempFile };
+		if (!manifest)
+		{
+			std::cerr << "Failed to open file " << tempFile << " for writing!\n";
+			return false;
+		}
+
+		manifest << "# LAB build manifest, used for incremental repacks.\n";
+		manifest << "!archive " << archiveSize << " " << archiveModifiedTime << "\n";
+		manifest << "!options " << dataAlignment << " " << (deduplicated ? 1 : 0) << " "
+		         << std::hex << std::setw(8) << std::setfill('0') << dataOrderChecksum << std::dec << "\n";
+		manifest << "# crc32c size mtime offset name\n";
+
+		for (const auto & entry : entries)
+		{
+			manifest << std::hex << std::setw(8) << std::setfill('0') << entry.checksum << std::dec
+			         << " " << entry.sizeInBytes << " " << entry.modifiedTime
+			         << " " << entry.dataOffset << " " << entry.name << "\n";
+		}
+
+		manifest.flush();
+		if (!manifest)
+		{
+			std::cerr << "Failed to write manifest file " << tempFile << "!\n";
+			std::remove(tempFile.c_str());
+			return false;
+		}
+	}
+
+	if (!filesys::replaceFile(tempFile, manifestFile))
+	{
+		std::remove(tempFile.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool LabBuildManifest::matchesArchive(const std::string & archiveFile) const
+{
+	std::size_t  sizeInBytes  = 0;
+	std::int64_t modifiedTime = 0;
+
+	return filesys::queryFileSize(archiveFile, sizeInBytes) &&
+	       filesys::queryFileModifiedTime(archiveFile, modifiedTime) &&
+	       sizeInBytes == archiveSize && modifiedTime == archiveModifiedTime;
+}
+
+bool LabBuildManifest::setArchive(const std::string & archiveFile)
+{
+	std::size_t sizeInBytes = 0;
+	if (!filesys::queryFileSize(archiveFile, sizeInBytes) ||
+	    !filesys::queryFileModifiedTime(archiveFile, archiveModifiedTime))
+	{
+		std::cerr << "Can't query size and time of LAB archive " << archiveFile << "!\n";
+		return false;
+	}
+
+	archiveSize = sizeInBytes;
+	return true;
+}
+
+bool LabBuildManifest::addEntry(Entry entry)
+{
+	if (!entryIndex.emplace(foldEntryName(entry.name), entries.size()).second)
+	{
+		return false;
+	}
+
+	entries.push_back(std::move(entry));
+	return true;
+}
+
+void LabBuildManifest::removeEntries(const std::vector<char> & removeMask)
+{
+	assert(removeMask.size() == entries.size());
+
+	std::size_t kept = 0;
+	for (std::size_t i = 0; i < entries.size(); ++i)
+	{
+		if (!removeMask[i])
+		{
+			if (kept != i)
+			{
+				entries[kept] = std::move(entries[i]);
+			}
+			++kept;
+		}
+	}
+
+	if (kept != entries.size())
+	{
+		entries.erase(entries.begin() + kept, entries.end());
+		rebuildIndex();
+	}
+}
+
+void LabBuildManifest::clearEntries()
+{
+	entries.clear();
+	entryIndex.clear();
+}
+
+std::size_t LabBuildManifest::findEntry(const std::string & name) const
+{
+	const auto iter = entryIndex.find(foldEntryName(name));
+	return (iter != entryIndex.end()) ? iter->second : EntryNotFound;
+}
+
+void LabBuildManifest::rebuildIndex()
+{
+	entryIndex.clear();
+	entryIndex.reserve(entries.size());
+
+	for (std::size_t i = 0; i < entries.size(); ++i)
+	{
+		entryIndex.emplace(foldEntryName(entries[i].name), i);
+	}
+}
+
+} // namespace ol {}
@@ -0,0 +1,114 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_build_manifest.hpp
+// Created on: 16/10/26
+// Brief: Sidecar manifest describing how a LAB archive was packed, for incremental repacks.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#ifndef OL_LAB_BUILD_MANIFEST_HPP
+#define OL_LAB_BUILD_MANIFEST_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ol
+{
+
+// ========================================================
+// class LabBuildManifest:
+// ========================================================
+
+//
+// Records, for each entry of a packed archive, the size and modification
+// time of the source file it came from, the CRC-32C of its data and where
+// the data is in the archive. The size and time of the archive itself are
+// kept too, so a manifest that no longer matches its archive (rebuilt by
+// other means, edited, replaced) can be detected and ignored.
+//
+// Saved as text, one entry per line after a few '!' lines with the archive
+// properties: "<crc32c hex> <size> <mtime> <offset> <name>". Lines starting
+// with '#' are comments.
+//
+class LabBuildManifest final
+{
+public:
+
+	struct Entry
+	{
+		std::string   name;         // As stored in the archive, '\' separated.
+		std::uint64_t sizeInBytes;
+		std::int64_t  modifiedTime; // Of the source file, nanoseconds since the Unix epoch.
+		std::uint32_t checksum;     // CRC-32C of the data.
+		std::uint32_t dataOffset;   // Absolute from the start of the archive.
+	};
+
+	LabBuildManifest();
+
+	// Usual sidecar name for an archive: "<archive>.manifest".
+	static std::string getFileNameFor(const std::string & archiveFile) { return archiveFile + ".manifest"; }
+
+	// Replaces the current contents. Returns false if the file is missing or malformed;
+	// only a malformed file is logged to STDERR, a missing one is normal on a first build.
+	bool load(const std::string & manifestFile);
+
+	// Writes to a temporary file next to it, then replaces manifestFile.
+	bool save(const std::string & manifestFile) const;
+
+	// Test if the archive file still has the size and modification time recorded.
+	bool matchesArchive(const std::string & archiveFile) const;
+
+	// Record the current size and modification time of the archive file.
+	bool setArchive(const std::string & archiveFile);
+
+	// Writer settings the archive was packed with. An archive packed with
+	// different settings can't be reused as is. The data order is identified
+	// by a checksum of the ordering file, zero if there was none.
+	void setPackOptions(std::uint32_t alignment, bool dedup, std::uint32_t orderChecksum = 0)
+	{
+		dataAlignment     = alignment;
+		deduplicated      = dedup;
+		dataOrderChecksum = orderChecksum;
+	}
+	std::uint32_t getDataAlignment() const { return dataAlignment; }
+	bool isDeduplicated() const { return deduplicated; }
+	std::uint32_t getDataOrderChecksum() const { return dataOrderChecksum; }
+
+	// Entries in archive order. Names must be unique, ignoring case;
+	// addEntry() returns false and adds nothing if the name is taken.
+	bool addEntry(Entry entry);
+	// Drops every entry whose removeMask element is nonzero, keeping the order of
+	// the rest, with a single index rebuild. The mask has one element per entry.
+	void removeEntries(const std::vector<char> & removeMask);
+	void clearEntries();
+	std::size_t getEntryCount() const { return entries.size(); }
+	const Entry & getEntry(std::size_t index) const { return entries[index]; }
+	Entry & getEntry(std::size_t index) { return entries[index]; }
+
+	// Index of the named entry, or EntryNotFound. Case-insensitive, '/' and '\' alike.
+	static constexpr std::size_t EntryNotFound = ~static_cast<std::size_t>(0);
+	std::size_t findEntry(const std::string & name) const;
+
+private:
+
+	void rebuildIndex();
+
+	std::vector<Entry> entries;
+	std::unordered_map<std::string, std::size_t> entryIndex; // Folded name => index.
+
+	std::uint64_t archiveSize;
+	std::int64_t  archiveModifiedTime;
+	std::uint32_t dataAlignment;
+	bool          deduplicated;
+	std::uint32_t dataOrderChecksum;
+};
+
+} // namespace ol {}
+
+#endif // OL_LAB_BUILD_MANIFEST_HPP
@@ -14,6 +14,10 @@
 #include "lab_common.hpp"
 #include "filesys_utils.hpp"
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 namespace ol
 {
 
@@ -142,4 +146,94 @@ void fileTypeIdForFileName(std::uint8_t id[4], const std::string & filename, con
 	}
 }
 
+// ========================================================
+// matchFileNamePattern():
+// ========================================================
+
+bool matchFileNamePattern(const char * pattern, const char * filename)
+{
+	// Iterative matcher with single-star backtracking: on a mismatch,
+	// retry from the last '*' with it swallowing one more character.
+	const char * starPattern  = nullptr;
+	const char * starFilename = nullptr;
+
+	while (*filename != '\0')
+	{
+		if (*pattern == '*')
+		{
+			starPattern  = ++pattern;
+			starFilename = filename;
+		}
+		else if (*pattern == '?' || (*pattern != '\0' && foldNameChar(*pattern) == foldNameChar(*filename)))
+		{
+			++pattern;
+			++filename;
+		}
+		else if (starPattern != nullptr)
+		{
+			pattern  = starPattern;
+			filename = ++starFilename;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	while (*pattern == '*')
+	{
+		++pattern;
+	}
+	return *pattern == '\0';
+}
+
+// ========================================================
+// parallelFor():
+// ========================================================
+
+void parallelFor(const std::size_t itemCount, int numThreads, const std::function<void(std::size_t)> & task)
+{
+	if (numThreads <= 0)
+	{
+		numThreads = static_cast<int>(std::thread::hardware_concurrency());
+	}
+	if (static_cast<std::size_t>(numThreads) > itemCount)
+	{
+		numThreads = static_cast<int>(itemCount);
+	}
+
+	// Not worth the thread startup cost.
+	if (numThreads <= 1)
+	{
+		for (std::size_t i = 0; i < itemCount; ++i)
+		{
+			task(i);
+		}
+		return;
+	}
+
+	std::atomic<std::size_t> nextItem{ 0 };
+	const auto worker = [&nextItem, itemCount, &task]()
+	{
+		for (std::size_t i = nextItem++; i < itemCount; i = nextItem++)
+		{
+			task(i);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(numThreads - 1);
+	for (int t = 1; t < numThreads; ++t)
+	{
+		threads.emplace_back(worker);
+	}
+
+	worker();
+
+	for (auto & thread : threads)
+	{
+		thread.join();
+	}
+}
+
 } // namespace ol {}
@@ -18,9 +18,7 @@
 #include <cctype>
 #include <string>
 #include <functional>
-#if defined(_WIN32)
 #include <algorithm>
-#endif
 
 namespace ol
 {
@@ -67,8 +65,34 @@ inline std::string uppercase(std::string str)
 	return str;
 }
 
+// DOS-style folding of entry names, so that names differing only in case or
+// in the kind of slash are the same entry. Used for every name lookup and key.
+inline unsigned char foldNameChar(const char c)
+{
+	return (c == '\\') ? '/' : static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+inline std::string foldEntryName(std::string name)
+{
+	for (auto & c : name)
+	{
+		c = static_cast<char>(foldNameChar(c));
+	}
+	return name;
+}
+
 void fileTypeIdForFileName(std::uint8_t id[4], const std::string & filename, const std::string & destLabFile);
 
+// DOS-style wildcard match of a filename against a pattern. '*' matches any run of
+// characters and '?' any single one. Case-insensitive, with '/' and '\' treated alike.
+bool matchFileNamePattern(const char * pattern, const char * filename);
+
+// Calls task(i) for each i in [0, itemCount), spreading the calls over numThreads
+// threads, the calling thread included. Items are handed out one at a time, so slow
+// items don't hold up the rest. Zero threads means one per hardware thread.
+// Returns when all items are done. The task must be safe to call concurrently.
+void parallelFor(std::size_t itemCount, int numThreads, const std::function<void(std::size_t)> & task);
+
 } // namespace ol {}
 
 #endif // OL_LAB_COMMON_HPP
@@ -0,0 +1,254 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_entry_cache.cpp
+// Created on: 16/10/26
+// Brief: Bounded-memory LRU cache of LAB entry data.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#include "lab_entry_cache.hpp"
+#include "lab_archive_reader.hpp"
+
+#include <cassert>
+#include <utility>
+
+namespace ol
+{
+
+// ========================================================
+// class LabEntryCache::Handle:
+// ========================================================
+
+LabEntryCache::Handle::Handle()
+	: cache { nullptr }
+	, item  { nullptr }
+{ }
+
+LabEntryCache::Handle::Handle(LabEntryCache * owner, CacheItem * cached)
+	: cache { owner  }
+	, item  { cached }
+{ }
+
+LabEntryCache::Handle::Handle(Handle && other)
+	: cache { other.cache }
+	, item  { other.item  }
+{
+	other.cache = nullptr;
+	other.item  = nullptr;
+}
+
+LabEntryCache::Handle & LabEntryCache::Handle::operator = (Handle && other)
+{
+	if (this != &other)
+	{
+		release();
+		std::swap(cache, other.cache);
+		std::swap(item,  other.item);
+	}
+	return *this;
+}
+
+LabEntryCache::Handle::~Handle()
+{
+	release();
+}
+
+void LabEntryCache::Handle::release()
+{
+	if (item != nullptr)
+	{
+		cache->unpin(item);
+		cache = nullptr;
+		item  = nullptr;
+	}
+}
+
+const std::uint8_t * LabEntryCache::Handle::getData() const
+{
+	return (item != nullptr) ? item->data.get() : nullptr;
+}
+
+std::size_t LabEntryCache::Handle::getSize() const
+{
+	return (item != nullptr) ? item->sizeInBytes : 0;
+}
+
+// ========================================================
+// class LabEntryCache:
+// ========================================================
+
+LabEntryCache::LabEntryCache(const LabArchiveReader & archiveReader, const std::size_t budget)
+	: reader     { archiveReader }
+	, byteBudget { budget }
+	, lruList    { }
+	, items      { }
+	, stats      { 0, 0, 0, 0, 0 }
+	, mutex      { }
+	, loaded     { }
+{
+	assert(reader.isOpen());
+}
+
+LabEntryCache::~LabEntryCache()
+{
+	assert(lruList.size() == items.size() && "Cache destroyed with pinned entries!");
+}
+
+LabEntryCache::Handle LabEntryCache::acquire(const std::string & entryName)
+{
+	const auto index = reader.findEntry(entryName);
+	if (index == LabArchiveReader::EntryNotFound)
+	{
+		return Handle{};
+	}
+	return acquire(index);
+}
+
+LabEntryCache::Handle LabEntryCache::acquire(const std::size_t entryIndex)
+{
+	assert(entryIndex < reader.getEntryCount());
+	std::unique_lock<std::mutex> lock{ mutex };
+
+	auto iter = items.find(entryIndex);
+	if (iter != items.end())
+	{
+		CacheItem * item = &iter->second;
+		if (!item->loading && item->data == nullptr)
+		{
+			return Handle{}; // Read failed, going away with its last waiter.
+		}
+
+		++stats.hits;
+		if (item->pinCount++ == 0)
+		{
+			lruList.erase(item->lruPosition);
+		}
+
+		// Someone else is reading it; wait rather than load it twice.
+		loaded.wait(lock, [item]() { return !item->loading; });
+		if (item->data == nullptr)
+		{
+			unpinFailed(item);
+			return Handle{};
+		}
+		return Handle{ this, item };
+	}
+
+	++stats.misses;
+
+	// Pinned and marked as loading while the lock is dropped for the read,
+	// so it can't be evicted and other threads wait for it.
+	CacheItem & item = items[entryIndex];
+	item.entryIndex  = entryIndex;
+	item.sizeInBytes = reader.getEntrySize(entryIndex);
+	item.pinCount    = 1;
+	item.loading     = true;
+	stats.entriesCached = items.size();
+
+	lock.unlock();
+	const auto sizeInBytes = item.sizeInBytes;
+	auto data = std::make_unique<std::uint8_t[]>(sizeInBytes > 0 ? sizeInBytes : 1);
+	const bool readOk = reader.readEntry(entryIndex, data.get(), sizeInBytes);
+	lock.lock();
+
+	item.loading = false;
+	loaded.notify_all();
+
+	if (!readOk)
+	{
+		unpinFailed(&item);
+		return Handle{};
+	}
+
+	item.data = std::move(data);
+	stats.bytesCached += sizeInBytes;
+
+	// Make room for the newcomer. Never evicts it, since it is pinned.
+	evictToBudget();
+	return Handle{ this, &item };
+}
+
+void LabEntryCache::setByteBudget(const std::size_t budget)
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	byteBudget = budget;
+	evictToBudget();
+}
+
+std::size_t LabEntryCache::getByteBudget() const
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	return byteBudget;
+}
+
+void LabEntryCache::clear()
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	while (!lruList.empty())
+	{
+		CacheItem * item = lruList.back();
+		lruList.pop_back();
+		stats.bytesCached -= item->sizeInBytes;
+		items.erase(item->entryIndex);
+	}
+	stats.entriesCached = items.size();
+}
+
+LabEntryCache::Stats LabEntryCache::getStats() const
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	return stats;
+}
+
+void LabEntryCache::resetStats()
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	stats.hits      = 0;
+	stats.misses    = 0;
+	stats.evictions = 0;
+}
+
+void LabEntryCache::unpin(CacheItem * item)
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	assert(item->pinCount > 0);
+
+	if (--item->pinCount == 0)
+	{
+		lruList.push_front(item);
+		item->lruPosition = lruList.begin();
+		evictToBudget();
+	}
+}
+
+void LabEntryCache::unpinFailed(CacheItem * item)
+{
+	assert(item->pinCount > 0 && item->data == nullptr);
+
+	// Never cached, so it never goes in the LRU list; the last one out removes it.
+	if (--item->pinCount == 0)
+	{
+		items.erase(item->entryIndex);
+		stats.entriesCached = items.size();
+	}
+}
+
+void LabEntryCache::evictToBudget()
+{
+	// Least recently used unpinned entries go first.
+	while (stats.bytesCached > byteBudget && !lruList.empty())
+	{
+		CacheItem * item = lruList.back();
+		lruList.pop_back();
+		stats.bytesCached -= item->sizeInBytes;
+		++stats.evictions;
+		items.erase(item->entryIndex);
+	}
+	stats.entriesCached = items.size();
+}
+
+} // namespace ol {}
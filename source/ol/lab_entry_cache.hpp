@@ -0,0 +1,148 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_entry_cache.hpp
+// Created on: 16/10/26
+// Brief: Bounded-memory LRU cache of LAB entry data.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#ifndef OL_LAB_ENTRY_CACHE_HPP
+#define OL_LAB_ENTRY_CACHE_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace ol
+{
+
+class LabArchiveReader;
+
+// ========================================================
+// class LabEntryCache:
+// ========================================================
+
+//
+// Keeps copies of recently used entries from a reader, up to a byte
+// budget. Meant for readers opened as MetadataOnly, so hot assets
+// don't go back to the disk each time while memory stays bounded.
+// Entries in use are pinned by a Handle and never evicted; when all
+// handles to an entry go away it becomes the most recently used one.
+// The budget can be exceeded temporarily if pinned data outgrows it.
+// All methods are thread safe. Misses read the archive without holding
+// the lock, so they don't stall hits on other threads; threads asking
+// for an entry that is being loaded wait for that read instead.
+//
+class LabEntryCache final
+{
+	struct CacheItem;
+
+public:
+
+	// Pinned reference to cached entry data. Movable, not copyable.
+	class Handle final
+	{
+	public:
+
+		Handle();
+		Handle(Handle && other);
+		Handle & operator = (Handle && other);
+		~Handle();
+
+		Handle(const Handle &) = delete;
+		Handle & operator = (const Handle &) = delete;
+
+		// Unpins the entry. The handle becomes invalid.
+		void release();
+
+		bool isValid() const { return item != nullptr; }
+		explicit operator bool() const { return isValid(); }
+
+		// Entry data, valid while the handle is. Null if invalid.
+		const std::uint8_t * getData() const;
+		std::size_t getSize() const;
+
+	private:
+
+		friend class LabEntryCache;
+		Handle(LabEntryCache * owner, CacheItem * cached);
+
+		LabEntryCache * cache;
+		CacheItem *     item;
+	};
+
+	// Counters for sizing the budget against real workloads.
+	struct Stats
+	{
+		std::uint64_t hits;          // acquire() calls served from memory.
+		std::uint64_t misses;        // acquire() calls that had to read the archive.
+		std::uint64_t evictions;     // Entries dropped to stay within the budget.
+		std::size_t   bytesCached;   // Current size of all cached data, pinned or not.
+		std::size_t   entriesCached; // Current number of cached entries.
+	};
+
+	// Disable copy and assignment.
+	LabEntryCache(const LabEntryCache &) = delete;
+	LabEntryCache & operator = (const LabEntryCache &) = delete;
+
+	// The reader must be open and outlive the cache.
+	LabEntryCache(const LabArchiveReader & reader, std::size_t byteBudget);
+
+	// Get a pinned handle to an entry, reading it into the cache on a miss.
+	// Returns an invalid handle if there is no such entry or reading fails.
+	Handle acquire(const std::string & entryName);
+	Handle acquire(std::size_t entryIndex);
+
+	// Change the budget, evicting unpinned entries if it shrinks.
+	void setByteBudget(std::size_t byteBudget);
+	std::size_t getByteBudget() const;
+
+	// Drop all unpinned entries. Pinned ones stay until released.
+	void clear();
+
+	// Snapshot of the counters. resetStats() zeros hits, misses and evictions.
+	Stats getStats() const;
+	void resetStats();
+
+	// All handles must have been released by now.
+	~LabEntryCache();
+
+private:
+
+	struct CacheItem
+	{
+		std::size_t                     entryIndex;
+		std::size_t                     sizeInBytes;
+		std::unique_ptr<std::uint8_t[]> data;        // Null while loading or if the read failed.
+		int                             pinCount;
+		bool                            loading;     // Being read by the thread that missed it.
+		std::list<CacheItem *>::iterator lruPosition; // Only valid while unpinned.
+	};
+
+	void unpin(CacheItem * item);
+	void unpinFailed(CacheItem * item); // Called with the lock held.
+	void evictToBudget();
+
+	const LabArchiveReader & reader;
+	std::size_t              byteBudget;
+
+	// Unpinned items only, most recently used at the front.
+	std::list<CacheItem *> lruList;
+	std::unordered_map<std::size_t, CacheItem> items;
+
+	Stats                   stats;
+	mutable std::mutex      mutex;
+	std::condition_variable loaded; // Signaled when an item stops loading.
+};
+
+} // namespace ol {}
+
+#endif // OL_LAB_ENTRY_CACHE_HPP
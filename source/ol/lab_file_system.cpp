@@ -0,0 +1,205 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_file_system.cpp
+// Created on: 16/10/26
+// Brief: Virtual file system over a stack of mounted LAB archives.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#include "lab_file_system.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+namespace ol
+{
+
+// ========================================================
+// class LabFileSystem:
+// ========================================================
+
+LabFileSystem::LabFileSystem()
+	: archives      { }
+	, entryRefs     { }
+	, nameIndex     { }
+	, accessTracing { false }
+{ }
+
+LabFileSystem::~LabFileSystem()
+{
+	unmountAll();
+}
+
+bool LabFileSystem::mount(const std::string & labFileName, const LabArchiveReader::OpenMode mode)
+{
+	auto archive = std::make_unique<LabArchiveReader>(labFileName, mode);
+	if (!archive->open())
+	{
+		std::cerr << "Failed to mount LAB archive " << labFileName << "!\n";
+		return false;
+	}
+
+	if (accessTracing)
+	{
+		archive->setAccessTracing(true);
+	}
+
+	archives.push_back(std::move(archive));
+	addArchiveToIndex(archives.size() - 1);
+	return true;
+}
+
+void LabFileSystem::unmountLast()
+{
+	if (archives.empty())
+	{
+		return;
+	}
+
+	// The index has keys pointing into this archive, so it can't be
+	// patched in place. Rebuild before closing it to be safe.
+	auto archive = std::move(archives.back());
+	archives.pop_back();
+	rebuildIndex();
+	archive->close();
+}
+
+void LabFileSystem::setAccessTracing(const bool enable)
+{
+	accessTracing = enable;
+	for (auto & archive : archives)
+	{
+		archive->setAccessTracing(enable);
+	}
+}
+
+void LabFileSystem::unmountAll()
+{
+	nameIndex.clear();
+	entryRefs.clear();
+	archives.clear();
+}
+
+std::size_t LabFileSystem::getArchiveCount() const
+{
+	return archives.size();
+}
+
+const LabArchiveReader & LabFileSystem::getArchive(const std::size_t archiveIndex) const
+{
+	assert(archiveIndex < archives.size());
+	return *archives[archiveIndex];
+}
+
+std::size_t LabFileSystem::getEntryCount() const
+{
+	return entryRefs.size();
+}
+
+bool LabFileSystem::findEntry(const std::string & entryName, EntryRef & entryRef) const
+{
+	const auto refIndex = nameIndex.find(entryName);
+	if (refIndex == LabNameIndex::NotFound)
+	{
+		entryRef = EntryRef{ nullptr, LabArchiveReader::EntryNotFound };
+		return false;
+	}
+
+	entryRef = entryRefs[refIndex];
+	return true;
+}
+
+bool LabFileSystem::hasEntry(const std::string & entryName) const
+{
+	return nameIndex.find(entryName) != LabNameIndex::NotFound;
+}
+
+bool LabFileSystem::getEntrySize(const std::string & entryName, std::size_t & sizeInBytes) const
+{
+	EntryRef entryRef;
+	if (!findEntry(entryName, entryRef))
+	{
+		sizeInBytes = 0;
+		return false;
+	}
+
+	sizeInBytes = entryRef.archive->getEntrySize(entryRef.index);
+	return true;
+}
+
+const std::uint8_t * LabFileSystem::getEntryData(const std::string & entryName, std::size_t * sizeInBytes) const
+{
+	EntryRef entryRef;
+	if (!findEntry(entryName, entryRef))
+	{
+		if (sizeInBytes != nullptr) { *sizeInBytes = 0; }
+		return nullptr;
+	}
+
+	const auto * data = entryRef.archive->getEntryData(entryRef.index);
+	if (sizeInBytes != nullptr)
+	{
+		*sizeInBytes = (data != nullptr) ? entryRef.archive->getEntrySize(entryRef.index) : 0;
+	}
+	return data;
+}
+
+bool LabFileSystem::readEntry(const std::string & entryName, void * destBuffer, const std::size_t bufferSizeBytes) const
+{
+	EntryRef entryRef;
+	if (!findEntry(entryName, entryRef))
+	{
+		std::cerr << "Entry \'" << entryName << "\' not found in any mounted LAB archive!\n";
+		return false;
+	}
+	return entryRef.archive->readEntry(entryRef.index, destBuffer, bufferSizeBytes);
+}
+
+void LabFileSystem::addArchiveToIndex(const std::size_t archiveIndex)
+{
+	const LabArchiveReader & archive = *archives[archiveIndex];
+	const auto entryCount = archive.getEntryCount();
+
+	// Worst case every name is new.
+	nameIndex.reserve(entryRefs.size() + entryCount);
+	entryRefs.reserve(entryRefs.size() + entryCount);
+
+	for (std::size_t i = 0; i < entryCount; ++i)
+	{
+		const char * name = archive.getEntryName(i);
+		const auto length = std::strlen(name);
+		const EntryRef entryRef{ &archive, i };
+
+		// Later archives win. Overridden entries keep their slot
+		// in entryRefs, it just points to the new archive now.
+		const auto refIndex = nameIndex.find(name, length);
+		if (refIndex != LabNameIndex::NotFound)
+		{
+			entryRefs[refIndex] = entryRef;
+		}
+		else
+		{
+			nameIndex.insert(name, length, static_cast<std::uint32_t>(entryRefs.size()));
+			entryRefs.push_back(entryRef);
+		}
+	}
+}
+
+void LabFileSystem::rebuildIndex()
+{
+	nameIndex.clear();
+	entryRefs.clear();
+
+	for (std::size_t a = 0; a < archives.size(); ++a)
+	{
+		addArchiveToIndex(a);
+	}
+}
+
+} // namespace ol {}
@@ -0,0 +1,108 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_file_system.hpp
+// Created on: 16/10/26
+// Brief: Virtual file system over a stack of mounted LAB archives.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#ifndef OL_LAB_FILE_SYSTEM_HPP
+#define OL_LAB_FILE_SYSTEM_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lab_archive_reader.hpp"
+#include "lab_name_index.hpp"
+
+namespace ol
+{
+
+// ========================================================
+// class LabFileSystem:
+// ========================================================
+
+//
+// Archives are mounted on top of each other, like the game does with
+// its base LABs and later patches or mods. An entry in an archive hides
+// any entry with the same name in the archives mounted before it.
+// All mounted entries share a single merged name index, so resolving
+// a name costs one hash lookup no matter how many archives are mounted.
+//
+class LabFileSystem final
+{
+public:
+
+	// Resolved entry: the archive that provides it and its index in that archive.
+	struct EntryRef
+	{
+		const LabArchiveReader * archive;
+		std::size_t              index;
+	};
+
+	// Disable copy and assignment.
+	LabFileSystem(const LabFileSystem &) = delete;
+	LabFileSystem & operator = (const LabFileSystem &) = delete;
+
+	LabFileSystem();
+
+	// Open an archive and mount it on top of the stack. Its entries take
+	// priority over the ones of all archives mounted before. Returns false
+	// if the archive can't be opened, in which case nothing changes.
+	bool mount(const std::string & labFileName,
+	           LabArchiveReader::OpenMode mode = LabArchiveReader::OpenMode::MemoryMapped);
+
+	// Unmount and close the archive on top of the stack, uncovering
+	// the entries it was hiding. No-op if nothing is mounted.
+	void unmountLast();
+
+	// Unmount and close all archives.
+	void unmountAll();
+
+	// Number of mounted archives. Archive 0 is the bottom of the stack.
+	std::size_t getArchiveCount() const;
+	const LabArchiveReader & getArchive(std::size_t archiveIndex) const;
+
+	// Number of distinct entry names across all mounted archives.
+	std::size_t getEntryCount() const;
+
+	// Resolve a name to the entry visible at the top of the stack. Lookups are
+	// DOS-style like LabArchiveReader::findEntry(). False if no archive has it.
+	bool findEntry(const std::string & entryName, EntryRef & entryRef) const;
+
+	// Same as the LabArchiveReader methods, on the resolved entry.
+	bool hasEntry(const std::string & entryName) const;
+	bool getEntrySize(const std::string & entryName, std::size_t & sizeInBytes) const;
+	const std::uint8_t * getEntryData(const std::string & entryName, std::size_t * sizeInBytes = nullptr) const;
+	bool readEntry(const std::string & entryName, void * destBuffer, std::size_t bufferSizeBytes) const;
+
+	// Turn access tracing on or off for every mounted archive and the ones mounted
+	// later. Each archive keeps its own trace: getArchive(i).saveAccessTrace().
+	void setAccessTracing(bool enable);
+	bool isAccessTracing() const { return accessTracing; }
+
+	// Destructor unmounts everything.
+	~LabFileSystem();
+
+private:
+
+	void addArchiveToIndex(std::size_t archiveIndex);
+	void rebuildIndex();
+
+	using ArchivePtr = std::unique_ptr<LabArchiveReader>;
+
+	std::vector<ArchivePtr> archives;  // Mount order, the last one has the highest priority.
+	std::vector<EntryRef>   entryRefs; // Merged entries. Values of the name index point in here.
+	LabNameIndex            nameIndex; // Keys point into the name lists of the mounted archives.
+	bool                    accessTracing;
+};
+
+} // namespace ol {}
+
+#endif // OL_LAB_FILE_SYSTEM_HPP
@@ -0,0 +1,179 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_name_index.cpp
+// Created on: 16/10/26
+// Brief: Flat open-addressing hash index mapping LAB entry names to integer values.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#include "lab_name_index.hpp"
+#include "lab_common.hpp"
+
+#include <cassert>
+
+namespace ol
+{
+
+static bool namesEqual(const char * a, const char * b, const std::size_t length)
+{
+	for (std::size_t i = 0; i < length; ++i)
+	{
+		if (foldNameChar(a[i]) != foldNameChar(b[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// ========================================================
+// class LabNameIndex:
+// ========================================================
+
+constexpr std::uint32_t LabNameIndex::NotFound;
+
+LabNameIndex::LabNameIndex()
+	: slots    { }
+	, keyCount { 0 }
+{ }
+
+void LabNameIndex::reset(const std::size_t maxNames)
+{
+	// Keep the load factor at or below 1/2 so probe sequences stay short.
+	std::size_t capacity = 8;
+	while (capacity < maxNames * 2)
+	{
+		capacity *= 2;
+	}
+
+	slots.assign(capacity, Slot{ nullptr, 0, 0, NotFound });
+	keyCount = 0;
+}
+
+void LabNameIndex::reserve(const std::size_t maxNames)
+{
+	if (maxNames * 2 > slots.size())
+	{
+		rehash(maxNames);
+	}
+}
+
+void LabNameIndex::clear()
+{
+	std::vector<Slot>().swap(slots);
+	keyCount = 0;
+}
+
+bool LabNameIndex::insert(const char * name, const std::size_t length, const std::uint32_t value)
+{
+	return insertImpl(name, length, value, /* replace = */ false);
+}
+
+bool LabNameIndex::insertOrAssign(const char * name, const std::size_t length, const std::uint32_t value)
+{
+	return insertImpl(name, length, value, /* replace = */ true);
+}
+
+std::uint32_t LabNameIndex::find(const char * name, const std::size_t length) const
+{
+	if (keyCount == 0)
+	{
+		return NotFound;
+	}
+
+	const Slot * slot = findSlot(name, length, hashName(name, length));
+	return (slot->name != nullptr) ? slot->value : NotFound;
+}
+
+std::uint32_t LabNameIndex::hashName(const char * name, const std::size_t length)
+{
+	// 32-bit FNV-1a over the folded characters.
+	std::uint32_t hash = 2166136261u;
+	for (std::size_t i = 0; i < length; ++i)
+	{
+		hash ^= foldNameChar(name[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+LabNameIndex::Slot * LabNameIndex::findSlot(const char * name, const std::size_t length, const std::uint32_t hash)
+{
+	const auto * constThis = this;
+	return const_cast<Slot *>(constThis->findSlot(name, length, hash));
+}
+
+const LabNameIndex::Slot * LabNameIndex::findSlot(const char * name, const std::size_t length, const std::uint32_t hash) const
+{
+	assert(!slots.empty());
+
+	// Linear probing. Returns the matching slot or the empty one ending the sequence.
+	const std::size_t mask = slots.size() - 1;
+	std::size_t i = hash & mask;
+	for (;;)
+	{
+		const Slot & slot = slots[i];
+		if (slot.name == nullptr)
+		{
+			return &slot;
+		}
+		if (slot.hash == hash && slot.length == length && namesEqual(slot.name, name, length))
+		{
+			return &slot;
+		}
+		i = (i + 1) & mask;
+	}
+}
+
+bool LabNameIndex::insertImpl(const char * name, const std::size_t length, const std::uint32_t value, const bool replace)
+{
+	assert(name != nullptr);
+	assert(value != NotFound);
+
+	if ((keyCount + 1) * 2 > slots.size())
+	{
+		rehash((keyCount + 1) * 2);
+	}
+
+	const std::uint32_t hash = hashName(name, length);
+	Slot * slot = findSlot(name, length, hash);
+
+	if (slot->name != nullptr)
+	{
+		if (replace)
+		{
+			slot->value = value;
+		}
+		return false;
+	}
+
+	slot->name   = name;
+	slot->length = static_cast<std::uint32_t>(length);
+	slot->hash   = hash;
+	slot->value  = value;
+	++keyCount;
+	return true;
+}
+
+void LabNameIndex::rehash(const std::size_t maxNames)
+{
+	std::vector<Slot> oldSlots;
+	oldSlots.swap(slots);
+
+	reset(maxNames);
+
+	for (const auto & slot : oldSlots)
+	{
+		if (slot.name != nullptr)
+		{
+			*findSlot(slot.name, slot.length, slot.hash) = slot;
+			++keyCount;
+		}
+	}
+}
+
+} // namespace ol {}
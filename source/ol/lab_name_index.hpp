@@ -0,0 +1,93 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_name_index.hpp
+// Created on: 16/10/26
+// Brief: Flat open-addressing hash index mapping LAB entry names to integer values.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#ifndef OL_LAB_NAME_INDEX_HPP
+#define OL_LAB_NAME_INDEX_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ol
+{
+
+// ========================================================
+// class LabNameIndex:
+// ========================================================
+
+//
+// Names are compared DOS-style: case-insensitive, with '/' and '\'
+// treated as the same character. Keys are not copied, the index only
+// keeps pointers to them, so the name strings must outlive the index.
+// Usually they point into the name list of an open archive.
+//
+class LabNameIndex final
+{
+public:
+
+	// Returned by find() when there is no such name.
+	static constexpr std::uint32_t NotFound = 0xFFFFFFFF;
+
+	LabNameIndex();
+
+	// Discard the current contents and preallocate the table
+	// for up to maxNames keys. Only allocates memory here.
+	void reset(std::size_t maxNames);
+
+	// Make room for at least maxNames keys, keeping the current ones.
+	void reserve(std::size_t maxNames);
+
+	// Remove all keys and release the table memory.
+	void clear();
+
+	// Add a new key. If the name is already present, keeps the
+	// existing value and returns false. Grows the table if needed.
+	bool insert(const char * name, std::size_t length, std::uint32_t value);
+
+	// Add a new key or replace the value of an existing one.
+	// Returns true if the key was new, false if it was replaced.
+	bool insertOrAssign(const char * name, std::size_t length, std::uint32_t value);
+
+	// Find the value associated with a name, or NotFound.
+	std::uint32_t find(const char * name, std::size_t length) const;
+	std::uint32_t find(const std::string & name) const { return find(name.data(), name.length()); }
+
+	// Number of keys in the index.
+	std::size_t size() const { return keyCount; }
+	bool empty() const { return keyCount == 0; }
+
+	// DOS-style name hash used by the index. Exposed for
+	// anyone that wants to precompute or reuse it.
+	static std::uint32_t hashName(const char * name, std::size_t length);
+
+private:
+
+	struct Slot
+	{
+		const char *  name;   // Null for an empty slot.
+		std::uint32_t length;
+		std::uint32_t hash;
+		std::uint32_t value;
+	};
+
+	Slot * findSlot(const char * name, std::size_t length, std::uint32_t hash);
+	const Slot * findSlot(const char * name, std::size_t length, std::uint32_t hash) const;
+	bool insertImpl(const char * name, std::size_t length, std::uint32_t value, bool replace);
+	void rehash(std::size_t maxNames);
+
+	std::vector<Slot> slots;    // Always a power-of-two size, at most half full.
+	std::size_t       keyCount;
+};
+
+} // namespace ol {}
+
+#endif // OL_LAB_NAME_INDEX_HPP
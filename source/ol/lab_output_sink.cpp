@@ -0,0 +1,173 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_output_sink.cpp
+// Created on: 16/10/26
+// Brief: Output destinations for LabArchiveWriter: files, descriptors, memory and callbacks.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#include "lab_output_sink.hpp"
+#include "filesys_utils.hpp"
+
+#include <errno.h>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace ol
+{
+
+// ========================================================
+// class LabOutputSink:
+// ========================================================
+
+LabOutputSink::~LabOutputSink()
+{ }
+
+// ========================================================
+// class LabFileSink:
+// ========================================================
+
+LabFileSink::LabFileSink(std::string filename)
+	: fileOut  { nullptr }
+	, fileName { std::move(filename) }
+{
+	assert(!fileName.empty());
+}
+
+LabFileSink::~LabFileSink()
+{
+	if (fileOut != nullptr)
+	{
+		std::fclose(fileOut);
+	}
+}
+
+bool LabFileSink::open()
+{
+	assert(fileOut == nullptr);
+
+	filesys::createPath(fileName);
+	fileOut = std::fopen(fileName.c_str(), "wb");
+
+	if (fileOut == nullptr)
+	{
+		std::cerr << "Failed to open file " << fileName << " for writing!\n";
+		return false;
+	}
+	return true;
+}
+
+bool LabFileSink::write(const void * data, const std::size_t sizeInBytes)
+{
+	assert(fileOut != nullptr);
+	return std::fwrite(data, sizeof(std::uint8_t), sizeInBytes, fileOut) == sizeInBytes;
+}
+
+bool LabFileSink::finish()
+{
+	if (fileOut == nullptr)
+	{
+		return false;
+	}
+
+	const bool ok = (std::fclose(fileOut) == 0);
+	fileOut = nullptr;
+	return ok;
+}
+
+// ========================================================
+// class LabFdSink:
+// ========================================================
+
+LabFdSink::LabFdSink(const int fd)
+	: fileDesc { fd }
+{
+	assert(fileDesc >= 0);
+}
+
+bool LabFdSink::write(const void * data, const std::size_t sizeInBytes)
+{
+	const auto * bytes = static_cast<const std::uint8_t *>(data);
+	std::size_t bytesLeft = sizeInBytes;
+
+	// Pipes and sockets take partial writes.
+	while (bytesLeft > 0)
+	{
+		#if defined(_WIN32)
+		const int chunk = static_cast<int>(bytesLeft < 0x40000000 ? bytesLeft : 0x40000000);
+		const int written = _write(fileDesc, bytes, chunk);
+		#else
+		const ssize_t written = ::write(fileDesc, bytes, bytesLeft);
+		if (written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		#endif
+		if (written <= 0)
+		{
+			std::cerr << "write() to fd " << fileDesc << " failed: " << std::strerror(errno) << ".\n";
+			return false;
+		}
+		bytes     += written;
+		bytesLeft -= static_cast<std::size_t>(written);
+	}
+	return true;
+}
+
+std::string LabFdSink::getName() const
+{
+	return "<fd " + std::to_string(fileDesc) + ">";
+}
+
+// ========================================================
+// class LabMemorySink:
+// ========================================================
+
+bool LabMemorySink::write(const void * data, const std::size_t sizeInBytes)
+{
+	const auto * bytes = static_cast<const std::uint8_t *>(data);
+	buffer.insert(buffer.end(), bytes, bytes + sizeInBytes);
+	return true;
+}
+
+void LabMemorySink::reserve(const std::uint64_t totalSizeInBytes)
+{
+	buffer.reserve(buffer.size() + static_cast<std::size_t>(totalSizeInBytes));
+}
+
+std::vector<std::uint8_t> LabMemorySink::takeBuffer()
+{
+	std::vector<std::uint8_t> result;
+	result.swap(buffer);
+	return result;
+}
+
+// ========================================================
+// class LabCallbackSink:
+// ========================================================
+
+LabCallbackSink::LabCallbackSink(WriteCallback callback, std::string name)
+	: writeCallback { std::move(callback) }
+	, sinkName      { std::move(name) }
+{
+	assert(writeCallback != nullptr);
+}
+
+bool LabCallbackSink::write(const void * data, const std::size_t sizeInBytes)
+{
+	return writeCallback(data, sizeInBytes);
+}
+
+} // namespace ol {}
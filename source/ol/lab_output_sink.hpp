@@ -0,0 +1,163 @@
+
+// ================================================================================================
+// -*- C++ -*-
+// File: lab_output_sink.hpp
+// Created on: 16/10/26
+// Brief: Output destinations for LabArchiveWriter: files, descriptors, memory and callbacks.
+//
+// This project's source code is released under the MIT License.
+// - http://opensource.org/licenses/MIT
+//
+// ================================================================================================
+
+#ifndef OL_LAB_OUTPUT_SINK_HPP
+#define OL_LAB_OUTPUT_SINK_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace ol
+{
+
+// ========================================================
+// class LabOutputSink:
+// ========================================================
+
+//
+// Where LabArchiveWriter sends the bytes of an archive. The writer
+// always produces the archive front to back through write(), except
+// when getFile() returns a file: then it may also use kernel-side
+// copies, preallocation and positional writes from several threads.
+//
+class LabOutputSink
+{
+public:
+
+	virtual ~LabOutputSink();
+
+	// Append bytes to the output. Returns false on error.
+	virtual bool write(const void * data, std::size_t sizeInBytes) = 0;
+
+	// Called once the whole archive was written. Flush/close here.
+	virtual bool finish() { return true; }
+
+	// Hint with the final archive size, given before the first write().
+	virtual void reserve(std::uint64_t /* totalSizeInBytes */) { }
+
+	// Seekable file behind the sink, or null if it is not a file.
+	virtual FILE * getFile() { return nullptr; }
+
+	// Used to guess entry type ids (see fileTypeIdForFileName) and in error messages.
+	virtual std::string getName() const = 0;
+};
+
+// ========================================================
+// class LabFileSink:
+// ========================================================
+
+// Writes to a named file, created along with its path by open().
+class LabFileSink final
+	: public LabOutputSink
+{
+public:
+
+	// Disable copy and assignment.
+	LabFileSink(const LabFileSink &) = delete;
+	LabFileSink & operator = (const LabFileSink &) = delete;
+
+	explicit LabFileSink(std::string filename);
+	~LabFileSink();
+
+	// Create or truncate the file. Returns false and logs to STDERR on error.
+	bool open();
+	bool isOpen() const { return fileOut != nullptr; }
+
+	bool write(const void * data, std::size_t sizeInBytes) override;
+	bool finish() override;
+	FILE * getFile() override { return fileOut; }
+	std::string getName() const override { return fileName; }
+
+private:
+
+	FILE *            fileOut;
+	const std::string fileName;
+};
+
+// ========================================================
+// class LabFdSink:
+// ========================================================
+
+// Writes to an already open file descriptor, such as a pipe or STDOUT,
+// strictly in order. The descriptor is not closed by the sink.
+class LabFdSink final
+	: public LabOutputSink
+{
+public:
+
+	explicit LabFdSink(int fd);
+
+	bool write(const void * data, std::size_t sizeInBytes) override;
+	std::string getName() const override;
+
+private:
+
+	const int fileDesc;
+};
+
+// ========================================================
+// class LabMemorySink:
+// ========================================================
+
+// Builds the archive in a growable memory buffer.
+class LabMemorySink final
+	: public LabOutputSink
+{
+public:
+
+	LabMemorySink() = default;
+
+	bool write(const void * data, std::size_t sizeInBytes) override;
+	void reserve(std::uint64_t totalSizeInBytes) override;
+	std::string getName() const override { return "<memory>"; }
+
+	// The archive written so far.
+	const std::vector<std::uint8_t> & getBuffer() const { return buffer; }
+
+	// Move the buffer out, leaving the sink empty.
+	std::vector<std::uint8_t> takeBuffer();
+
+private:
+
+	std::vector<std::uint8_t> buffer;
+};
+
+// ========================================================
+// class LabCallbackSink:
+// ========================================================
+
+// Hands each block of the archive to a user function, in order.
+// The callback returns false to abort writing.
+class LabCallbackSink final
+	: public LabOutputSink
+{
+public:
+
+	using WriteCallback = std::function<bool(const void * data, std::size_t sizeInBytes)>;
+
+	explicit LabCallbackSink(WriteCallback callback, std::string name = "<callback>");
+
+	bool write(const void * data, std::size_t sizeInBytes) override;
+	std::string getName() const override { return sinkName; }
+
+private:
+
+	WriteCallback     writeCallback;
+	const std::string sinkName;
+};
+
+} // namespace ol {}
+
+#endif // OL_LAB_OUTPUT_SINK_HPP